@@ -4,6 +4,7 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/time.h>
 #include <pthread.h>
 #include <assert.h>
 
@@ -17,6 +18,44 @@ static vg_addr_t activity;
 /* Initialized by the machine-specific startup-code.  */
 extern struct hurd_startup_data *__hurd_startup_data;
 
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+/* A histogram of the time the workers take to access a page.  Bucket
+   B counts the accesses that took at least 2^(B-1) and less than 2^B
+   microseconds.  Accesses that take less than a microsecond (bucket
+   0) are assumed not to have faulted.  */
+#define LATENCY_BUCKETS 32
+static int latency[LATENCY_BUCKETS];
+
+/* Return the upper bound of the bucket containing the Pth percentile
+   of the faulting accesses, in microseconds.  */
+static int
+latency_percentile (int p)
+{
+  int faults = 0;
+  int b;
+  for (b = 1; b < LATENCY_BUCKETS; b ++)
+    faults += latency[b];
+
+  int seen = 0;
+  for (b = 1; b < LATENCY_BUCKETS; b ++)
+    {
+      seen += latency[b];
+      if ((uint64_t) seen * 100 >= (uint64_t) faults * p)
+	return 1 << b;
+    }
+  return 0;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -123,9 +162,22 @@ main (int argc, char *argv[])
 	for (j = 0; j < SIZE; j += PAGESIZE)
 	  {
 	    uintptr_t *p = buffers[i] + j;
-	    assertx (p[0] == j && p[1] == hurd_myself (),
+
+	    uint64_t start = now ();
+	    uintptr_t offset = * (volatile uintptr_t *) p;
+	    int us = now () - start;
+
+	    int b = 0;
+	    while (us && b < LATENCY_BUCKETS - 1)
+	      {
+		us >>= 1;
+		b ++;
+	      }
+	    __sync_fetch_and_add (&latency[b], 1);
+
+	    assertx (offset == j && p[1] == hurd_myself (),
 		     "%x: %x =? %x, thread: %x",
-		     p, p[0], j, p[1]);
+		     p, offset, j, p[1]);
 
 	    t += * (int *) (buffers[i] + j);
 	  }
@@ -213,6 +265,14 @@ main (int argc, char *argv[])
       printf ("\n");
     }
 
+  int faults = 0;
+  for (i = 1; i < LATENCY_BUCKETS; i ++)
+    faults += latency[i];
+  printf ("%d of %d page accesses faulted; fault latency: "
+	  "p50 < %d us, p99 < %d us\n",
+	  faults, faults + latency[0],
+	  latency_percentile (50), latency_percentile (99));
+
   printf ("Done!\n");
 
   return 0;
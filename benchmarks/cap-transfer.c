@@ -0,0 +1,114 @@
+/* Measure the cost of transferring capabilities in a message.
+
+   For N from 1 to CAPS, a message carrying N capabilities is sent
+   ITERATIONS times from one of our messengers to another of our
+   messengers.  The source capabilities designate pages; the target
+   slots are consecutive slots in a capability page.  The average time
+   per message and per capability is printed for each N.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <string.h>
+#include <assert.h>
+
+#include <viengoos/ipc.h>
+#include <viengoos/message.h>
+#include <hurd/storage.h>
+#include <hurd/message-buffer.h>
+#include <hurd/stddef.h>
+#include <hurd/startup.h>
+
+/* The maximum number of capabilities per message.  */
+#define CAPS 64
+
+#define ITERATIONS 1000
+
+static vg_addr_t activity;
+
+/* Initialized by the machine-specific startup-code.  */
+extern struct hurd_startup_data *__hurd_startup_data;
+
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+int
+main (int argc, char *argv[])
+{
+  activity = __hurd_startup_data->activity;
+
+  printf ("%s running...\n", argv[0]);
+
+  vg_addr_t pages[CAPS];
+  int i;
+  for (i = 0; i < CAPS; i ++)
+    pages[i] = storage_alloc (activity, vg_cap_page,
+			      STORAGE_LONG_LIVED, VG_OBJECT_POLICY_DEFAULT,
+			      VG_ADDR_VOID).addr;
+
+  vg_addr_t cappage = storage_alloc (activity, vg_cap_cappage,
+				     STORAGE_LONG_LIVED,
+				     VG_OBJECT_POLICY_DEFAULT,
+				     VG_ADDR_VOID).addr;
+  vg_addr_t slots[CAPS];
+  for (i = 0; i < CAPS; i ++)
+    slots[i] = vg_addr_extend (cappage, i, VG_CAPPAGE_SLOTS_LOG2);
+
+  struct hurd_message_buffer *mb = hurd_message_buffer_alloc ();
+
+  printf ("caps\tus/msg\tns/cap\n");
+
+  int n;
+  for (n = 1; n <= CAPS; n *= 2)
+    {
+      vg_message_clear (mb->request);
+      vg_message_append_caps (mb->request, n, pages);
+
+      uint64_t start = now ();
+
+      int j;
+      for (j = 0; j < ITERATIONS; j ++)
+	{
+	  vg_message_clear (mb->reply);
+	  vg_message_append_caps (mb->reply, n, slots);
+
+	  error_t err = vg_ipc (VG_IPC_RECEIVE
+				| VG_IPC_RECEIVE_SET_ASROOT_TO_CALLERS
+				| VG_IPC_SEND | VG_IPC_SEND_NONBLOCKING
+				| VG_IPC_SEND_SET_ASROOT_TO_CALLERS
+				| VG_IPC_RETURN,
+				activity, mb->receiver_strong, VG_ADDR_VOID,
+				activity, mb->receiver,
+				mb->sender, VG_ADDR_VOID);
+	  if (err)
+	    {
+	      printf ("IPC failed: %d\n", err);
+	      return 1;
+	    }
+	}
+
+      uint64_t us = now () - start;
+
+      assert (vg_message_cap_count (mb->reply) == n);
+      for (i = 0; i < n; i ++)
+	assert (! VG_ADDR_IS_VOID (vg_message_cap (mb->reply, i)));
+
+      printf ("%d\t%lld\t%lld\n", n, (long long) us / ITERATIONS,
+	      (long long) us * 1000 / ITERATIONS / n);
+    }
+
+  hurd_message_buffer_free (mb);
+
+  printf ("Done!\n");
+
+  return 0;
+}
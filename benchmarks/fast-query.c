@@ -0,0 +1,113 @@
+/* Measure the latency of trivial kernel queries.
+
+   The calling thread's id and a page's status are queried ITERATIONS
+   times, first using the normal RPC stubs and then using fast
+   queries (see vg_ipc_fast).  The average latency of each query in
+   each mode is printed.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <assert.h>
+
+#include <viengoos/ipc.h>
+#include <viengoos/cap.h>
+#include <viengoos/thread.h>
+#include <hurd/storage.h>
+#include <hurd/stddef.h>
+#include <hurd/startup.h>
+
+#define ITERATIONS 100000
+
+static vg_addr_t activity;
+
+/* Initialized by the machine-specific startup-code.  */
+extern struct hurd_startup_data *__hurd_startup_data;
+
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+int
+main (int argc, char *argv[])
+{
+  activity = __hurd_startup_data->activity;
+
+  printf ("%s running...\n", argv[0]);
+
+  vg_addr_t page = storage_alloc (activity, vg_cap_page,
+				  STORAGE_LONG_LIVED, VG_OBJECT_POLICY_DEFAULT,
+				  VG_ADDR_VOID).addr;
+
+  vg_thread_id_t self;
+  error_t err = vg_thread_id (VG_ADDR_VOID, VG_ADDR_VOID, &self);
+  assert_perror (err);
+
+  printf ("query\tmode\tns/op\n");
+
+  int fast;
+  for (fast = 0; fast < 2; fast ++)
+    {
+      const char *mode = fast ? "fast" : "rpc";
+
+      uint64_t start = now ();
+
+      int i;
+      for (i = 0; i < ITERATIONS; i ++)
+	{
+	  vg_thread_id_t tid;
+	  if (fast)
+	    {
+	      uintptr_t result;
+	      err = vg_ipc_fast (VG_thread_id, VG_ADDR_VOID, 0, &result);
+	      tid = result;
+	    }
+	  else
+	    err = vg_thread_id (VG_ADDR_VOID, VG_ADDR_VOID, &tid);
+	  if (err)
+	    {
+	      printf ("thread_id (%s) failed: %d\n", mode, err);
+	      return 1;
+	    }
+	  assert (tid == self);
+	}
+
+      uint64_t us = now () - start;
+      printf ("thread_id\t%s\t%lld\n",
+	      mode, (long long) us * 1000 / ITERATIONS);
+
+      start = now ();
+
+      for (i = 0; i < ITERATIONS; i ++)
+	{
+	  uintptr_t status;
+	  if (fast)
+	    err = vg_ipc_fast (VG_object_status, page, false, &status);
+	  else
+	    err = vg_object_status (activity, page, false, &status);
+	  if (err)
+	    {
+	      printf ("object_status (%s) failed: %d\n", mode, err);
+	      return 1;
+	    }
+	}
+
+      us = now () - start;
+      printf ("object_status\t%s\t%lld\n",
+	      mode, (long long) us * 1000 / ITERATIONS);
+    }
+
+  storage_free (page, false);
+
+  printf ("Done!\n");
+
+  return 0;
+}
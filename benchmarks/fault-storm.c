@@ -0,0 +1,146 @@
+/* Measure the rate at which concurrent threads can fault in pages of
+   their own mappings.
+
+   MAPS small mappings are created so that there is a realistic number
+   of maps to search.  Then, for T = 1, 2, 4, 8 and 16, T regions of
+   PAGES pages are mapped and T threads each fault in the pages of
+   their own region in a random order, which defeats read ahead so
+   that every page fault is resolved separately.  Each thread has its
+   own mapping so that the threads don't contend for a pager's lock.
+   The number of faults map_fault handled (see map_readahead_stats in
+   libhurd-mm/map.h) and the aggregate number of faults per second are
+   printed for each T.  */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include <hurd/stddef.h>
+#include <hurd/map.h>
+
+/* The maximum number of faulting threads.  */
+#define THREADS 16
+
+/* The number of pages each thread faults in.  */
+#define PAGES 512
+
+/* The number of additional mappings.  */
+#define MAPS 256
+
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+/* Each thread's region.  */
+static char *regions[THREADS];
+
+/* The number of threads that have yet to start faulting.  The threads
+   spin until it drops to zero so that they start at about the same
+   time.  */
+static volatile int waiting;
+
+static void *
+worker (void *arg)
+{
+  int id = (intptr_t) arg;
+  char *base = regions[id];
+
+  /* Visit the pages in a random order.  */
+  int order[PAGES];
+  int i;
+  for (i = 0; i < PAGES; i ++)
+    order[i] = i;
+
+  unsigned int seed = id + 1;
+  for (i = PAGES - 1; i > 0; i --)
+    {
+      int j = rand_r (&seed) % (i + 1);
+      int t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+
+  __sync_fetch_and_add (&waiting, -1);
+  while (waiting > 0)
+    ;
+
+  for (i = 0; i < PAGES; i ++)
+    base[order[i] * PAGESIZE] = i;
+
+  return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+  printf ("%s running...\n", argv[0]);
+
+  int i;
+  for (i = 0; i < MAPS; i ++)
+    {
+      void *p = mmap (0, PAGESIZE, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      assert (p != MAP_FAILED);
+    }
+
+  printf ("threads\tfaults\tus\tfaults/s\n");
+
+  int t;
+  for (t = 1; t <= THREADS; t *= 2)
+    {
+      pthread_t threads[THREADS];
+
+      for (i = 0; i < t; i ++)
+	{
+	  regions[i] = mmap (0, PAGES * PAGESIZE, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	  assert (regions[i] != MAP_FAILED);
+	}
+
+      waiting = t;
+
+      for (i = 0; i < t; i ++)
+	{
+	  int err = pthread_create (&threads[i], NULL, worker,
+				    (void *) (intptr_t) i);
+	  if (err)
+	    {
+	      printf ("Failed to create thread: %s\n", strerror (err));
+	      return 1;
+	    }
+	}
+
+      while (waiting > 0)
+	;
+      int faults_before = map_readahead_stats.faults;
+      uint64_t start = now ();
+
+      for (i = 0; i < t; i ++)
+	pthread_join (threads[i], NULL);
+
+      uint64_t us = now () - start;
+      int faults = map_readahead_stats.faults - faults_before;
+      printf ("%d\t%d\t%lld\t%lld\n", t, faults, (long long) us,
+	      us ? (long long) faults * 1000000 / us : 0);
+
+      for (i = 0; i < t; i ++)
+	munmap (regions[i], PAGES * PAGESIZE);
+    }
+
+  printf ("Done!\n");
+
+  return 0;
+}
@@ -0,0 +1,178 @@
+/* Measure futex performance when many futexes share a page.
+
+   MUTEXES mutexes are placed on a single page.  For each T from 1 to
+   THREADS, T threads repeatedly lock a pseudo-randomly chosen mutex,
+   do a bit of work and unlock it.  As all the mutexes are on the same
+   page, every waiter is on the same object's wait queue: wake ups
+   should nevertheless not get slower as the number of waiters on the
+   other mutexes grows.  The number of lock operations per second is
+   printed for each T.
+
+   Finally, the accuracy of timed waits is measured by waiting on a
+   condition variable that is never signalled.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <hurd/stddef.h>
+
+/* The maximum number of contending threads.  */
+#define THREADS 16
+
+/* The number of mutexes on the page.  */
+#define MUTEXES 64
+
+/* The number of lock operations each thread performs per round.  */
+#define ITERATIONS 10000
+
+/* The number of timed waits and their length in microseconds.  */
+#define TIMED_WAITS 20
+#define TIMED_WAIT_US 15000
+
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+static union
+{
+  struct
+  {
+    pthread_mutex_t mutexes[MUTEXES];
+    int counters[MUTEXES];
+  };
+  char page[PAGESIZE];
+} shared __attribute__ ((aligned (PAGESIZE)));
+
+/* The number of threads that have yet to start.  */
+static volatile int waiting;
+
+static void *
+worker (void *arg)
+{
+  uint32_t seed = (intptr_t) arg + 1;
+
+  __sync_fetch_and_add (&waiting, -1);
+  while (waiting > 0)
+    ;
+
+  int i;
+  for (i = 0; i < ITERATIONS; i ++)
+    {
+      seed = seed * 1103515245 + 12345;
+      int m = (seed >> 8) % MUTEXES;
+
+      pthread_mutex_lock (&shared.mutexes[m]);
+      int j;
+      for (j = 0; j < 100; j ++)
+	shared.counters[m] ++;
+      pthread_mutex_unlock (&shared.mutexes[m]);
+    }
+
+  return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+  printf ("%s running...\n", argv[0]);
+
+  int i;
+  for (i = 0; i < MUTEXES; i ++)
+    pthread_mutex_init (&shared.mutexes[i], NULL);
+
+  printf ("threads\tlocks\tus\tlocks/s\n");
+
+  int t;
+  for (t = 1; t <= THREADS; t *= 2)
+    {
+      pthread_t threads[THREADS];
+
+      memset (shared.counters, 0, sizeof (shared.counters));
+      waiting = t;
+
+      for (i = 0; i < t; i ++)
+	{
+	  int err = pthread_create (&threads[i], NULL, worker,
+				    (void *) (intptr_t) i);
+	  if (err)
+	    {
+	      printf ("Failed to create thread: %s\n", strerror (err));
+	      return 1;
+	    }
+	}
+
+      while (waiting > 0)
+	;
+      uint64_t start = now ();
+
+      for (i = 0; i < t; i ++)
+	pthread_join (threads[i], NULL);
+
+      uint64_t us = now () - start;
+
+      int total = 0;
+      for (i = 0; i < MUTEXES; i ++)
+	total += shared.counters[i];
+      assert (total == t * ITERATIONS * 100);
+
+      int locks = t * ITERATIONS;
+      printf ("%d\t%d\t%lld\t%lld\n", t, locks, (long long) us,
+	      us ? (long long) locks * 1000000 / us : 0);
+    }
+
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+  pthread_mutex_t *mutex = &shared.mutexes[0];
+
+  uint64_t late = 0;
+  uint64_t max_late = 0;
+  for (i = 0; i < TIMED_WAITS; i ++)
+    {
+      struct timeval tv;
+      gettimeofday (&tv, NULL);
+
+      uint64_t deadline = tv.tv_sec * 1000000ULL + tv.tv_usec + TIMED_WAIT_US;
+      struct timespec abstime;
+      abstime.tv_sec = deadline / 1000000;
+      abstime.tv_nsec = (deadline % 1000000) * 1000;
+
+      pthread_mutex_lock (mutex);
+      int err;
+      do
+	err = pthread_cond_timedwait (&cond, mutex, &abstime);
+      while (err == 0);
+      pthread_mutex_unlock (mutex);
+
+      uint64_t end = now ();
+      if (err != ETIMEDOUT)
+	{
+	  printf ("Timed wait failed: %s\n", strerror (err));
+	  return 1;
+	}
+
+      uint64_t l = end > deadline ? end - deadline : 0;
+      late += l;
+      if (l > max_late)
+	max_late = l;
+    }
+
+  printf ("timed wait of %d us: %lld us late on average, %lld at most\n",
+	  TIMED_WAIT_US, (long long) (late / TIMED_WAITS),
+	  (long long) max_late);
+
+  printf ("Done!\n");
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+/* Measure the cost of allocating and freeing message buffers as the
+   number of threads grows.
+
+   For T = 1, 2, 4, 8 and 16, T threads each allocate DEPTH message
+   buffers and then free them again, ROUNDS times.  The average time
+   per allocation and free pair and the number of times the threads'
+   caches were refilled and drained are printed for each T.  */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include <hurd/message-buffer.h>
+#include <hurd/stddef.h>
+
+/* The maximum number of threads.  */
+#define THREADS 16
+
+/* The number of times each thread allocates DEPTH buffers.  */
+#define ROUNDS 10000
+
+/* The number of buffers a thread holds at once.  An RPC typically
+   holds one; a thread that has queued a number of requests holds
+   more.  */
+#define DEPTH 3
+
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+/* The number of threads that have yet to start.  The threads spin
+   until it drops to zero so that they start at about the same
+   time.  */
+static volatile int waiting;
+
+static void *
+worker (void *arg)
+{
+  __sync_fetch_and_add (&waiting, -1);
+  while (waiting > 0)
+    ;
+
+  int r;
+  for (r = 0; r < ROUNDS; r ++)
+    {
+      struct hurd_message_buffer *mbs[DEPTH];
+
+      int i;
+      for (i = 0; i < DEPTH; i ++)
+	{
+	  mbs[i] = hurd_message_buffer_alloc ();
+	  assert (mbs[i]);
+	}
+
+      for (i = DEPTH - 1; i >= 0; i --)
+	hurd_message_buffer_free (mbs[i]);
+    }
+
+  return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+  printf ("%s running...\n", argv[0]);
+
+  printf ("threads\tns/op\trefills\tdrains\tcreates\n");
+
+  int t;
+  for (t = 1; t <= THREADS; t *= 2)
+    {
+      pthread_t threads[THREADS];
+
+      struct hurd_message_buffer_stats before;
+      hurd_message_buffer_stats (&before);
+
+      waiting = t;
+
+      int i;
+      for (i = 0; i < t; i ++)
+	{
+	  int err = pthread_create (&threads[i], NULL, worker, NULL);
+	  if (err)
+	    {
+	      printf ("Failed to create thread: %s\n", strerror (err));
+	      return 1;
+	    }
+	}
+
+      while (waiting > 0)
+	;
+      uint64_t start = now ();
+
+      for (i = 0; i < t; i ++)
+	pthread_join (threads[i], NULL);
+
+      uint64_t us = now () - start;
+
+      struct hurd_message_buffer_stats after;
+      hurd_message_buffer_stats (&after);
+
+      long long ops = (long long) t * ROUNDS * DEPTH;
+      printf ("%d\t%lld\t%ld\t%ld\t%ld\n", t, (long long) us * 1000 / ops,
+	      (long) (after.refills - before.refills),
+	      (long) (after.drains - before.drains),
+	      (long) (after.creates - before.creates));
+    }
+
+  printf ("Done!\n");
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+/* Measure the latency of address space allocation as the address
+   space becomes fragmented.
+
+   Each round, BATCH anonymous mappings of between 1 and MAX_PAGES
+   pages are created and then a random half of all live mappings is
+   destroyed, punching holes in the address space.  After each round,
+   the number of live mappings and the average time per mmap and per
+   munmap in that round are printed.  */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+#include <hurd/stddef.h>
+
+#define ROUNDS 20
+#define BATCH 1000
+#define MAX_PAGES 16
+
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+struct mapping
+{
+  void *addr;
+  size_t length;
+};
+
+static struct mapping mappings[ROUNDS * BATCH];
+
+int
+main (int argc, char *argv[])
+{
+  printf ("%s running...\n", argv[0]);
+
+  srand (1);
+
+  int live = 0;
+
+  printf ("round\tlive\tus/mmap\tus/munmap\n");
+
+  int round;
+  for (round = 0; round < ROUNDS; round ++)
+    {
+      uint64_t start = now ();
+
+      int i;
+      for (i = 0; i < BATCH; i ++)
+	{
+	  size_t length = (1 + rand () % MAX_PAGES) * PAGESIZE;
+	  void *addr = mmap (NULL, length, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	  if (addr == MAP_FAILED)
+	    {
+	      printf ("mmap failed after %d mappings\n", live);
+	      return 1;
+	    }
+
+	  mappings[live].addr = addr;
+	  mappings[live].length = length;
+	  live ++;
+	}
+
+      uint64_t map_us = now () - start;
+
+      int count = live / 2;
+      start = now ();
+
+      for (i = 0; i < count; i ++)
+	{
+	  int j = rand () % live;
+	  munmap (mappings[j].addr, mappings[j].length);
+	  mappings[j] = mappings[-- live];
+	}
+
+      uint64_t unmap_us = now () - start;
+
+      printf ("%d\t%d\t%lld\t%lld\n", round, live,
+	      (long long) map_us / BATCH,
+	      count ? (long long) unmap_us / count : 0);
+    }
+
+  printf ("Done!\n");
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+/* Measure the cost of invoking kernel objects via a submission ring.
+
+   BATCH capabilities are copied into consecutive slots of a
+   capability page, ITERATIONS times, first using one RPC per copy and
+   then by queuing the copies in a submission ring and invoking
+   vg_ring_submit once.  The average time per copy is printed for each
+   mode.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <string.h>
+#include <assert.h>
+
+#include <viengoos/cap.h>
+#include <viengoos/ring.h>
+#include <viengoos/message.h>
+#include <hurd/storage.h>
+#include <hurd/message-buffer.h>
+#include <hurd/stddef.h>
+#include <hurd/startup.h>
+
+/* The number of copies per submission.  */
+#define BATCH 32
+
+#define ITERATIONS 1000
+
+static vg_addr_t activity;
+
+/* Initialized by the machine-specific startup-code.  */
+extern struct hurd_startup_data *__hurd_startup_data;
+
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+int
+main (int argc, char *argv[])
+{
+  activity = __hurd_startup_data->activity;
+
+  printf ("%s running...\n", argv[0]);
+
+  vg_addr_t page = storage_alloc (activity, vg_cap_page,
+				  STORAGE_LONG_LIVED, VG_OBJECT_POLICY_DEFAULT,
+				  VG_ADDR_VOID).addr;
+
+  vg_addr_t cappage = storage_alloc (activity, vg_cap_cappage,
+				     STORAGE_LONG_LIVED,
+				     VG_OBJECT_POLICY_DEFAULT,
+				     VG_ADDR_VOID).addr;
+  vg_addr_t slots[BATCH];
+  int i;
+  for (i = 0; i < BATCH; i ++)
+    slots[i] = vg_addr_extend (cappage, i, VG_CAPPAGE_SLOTS_LOG2);
+
+  /* The ring and the entries' message buffers.  */
+  struct hurd_message_buffer *ring_mb = hurd_message_buffer_alloc ();
+  struct vg_ring *ring = (struct vg_ring *) ring_mb->request;
+  memset (ring, 0, sizeof (*ring));
+
+  struct hurd_message_buffer *mbs[BATCH];
+  for (i = 0; i < BATCH; i ++)
+    mbs[i] = hurd_message_buffer_alloc ();
+
+  printf ("mode\tus/op\n");
+
+  uint64_t start = now ();
+
+  int j;
+  for (j = 0; j < ITERATIONS; j ++)
+    for (i = 0; i < BATCH; i ++)
+      {
+	error_t err = vg_cap_copy (activity, VG_ADDR_VOID, slots[i],
+				   VG_ADDR_VOID, page,
+				   0, VG_CAP_PROPERTIES_DEFAULT);
+	if (err)
+	  {
+	    printf ("cap_copy failed: %d\n", err);
+	    return 1;
+	  }
+      }
+
+  uint64_t us = now () - start;
+  printf ("rpc\t%lld\n", (long long) us / (ITERATIONS * BATCH));
+
+  start = now ();
+
+  for (j = 0; j < ITERATIONS; j ++)
+    {
+      struct vg_ring_entry *entries[BATCH];
+      for (i = 0; i < BATCH; i ++)
+	{
+	  entries[i] = vg_ring_entry_alloc (ring);
+	  assert (entries[i]);
+
+	  entries[i]->buffer = VG_PTR_TO_PAGE (mbs[i]->request);
+	  vg_cap_copy_send_marshal (mbs[i]->request, slots[i],
+				    VG_ADDR_VOID, page,
+				    0, VG_CAP_PROPERTIES_DEFAULT,
+				    VG_ADDR_VOID);
+	}
+
+      int count;
+      error_t err = vg_ring_submit (activity, VG_ADDR_VOID,
+				    VG_PTR_TO_PAGE (ring), &count);
+      if (err || count != BATCH)
+	{
+	  printf ("ring_submit failed: %d (%d of %d entries)\n",
+		  err, count, BATCH);
+	  return 1;
+	}
+
+      for (i = 0; i < BATCH; i ++)
+	if (entries[i]->status)
+	  {
+	    printf ("cap_copy failed: %d\n", (int) entries[i]->status);
+	    return 1;
+	  }
+    }
+
+  us = now () - start;
+  printf ("ring\t%lld\n", (long long) us / (ITERATIONS * BATCH));
+
+  for (i = 0; i < BATCH; i ++)
+    hurd_message_buffer_free (mbs[i]);
+  hurd_message_buffer_free (ring_mb);
+
+  printf ("Done!\n");
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+/* Count the page faults taken by a sequential scan of a large buffer.
+
+   The buffer is scanned twice: first writing to each page, which
+   faults the memory in, then reading each page.  The number of faults
+   is taken from the activity's statistics, so the count includes any
+   faults taken by other threads using the same activity.  With
+   superpages enabled (see viengoos/superpage.h), a scan should take
+   roughly 1 / SUPERPAGE_OBJECTS as many faults as pages touched.  The
+   read ahead counters (see libhurd-mm/map.h) are also printed.  */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <assert.h>
+
+#include <viengoos/activity.h>
+#include <hurd/stddef.h>
+#include <hurd/startup.h>
+#include <hurd/map.h>
+
+#define SIZE (64 * 1024 * 1024)
+
+static vg_addr_t activity;
+
+/* Initialized by the machine-specific startup-code.  */
+extern struct hurd_startup_data *__hurd_startup_data;
+
+/* Return the statistics of the periods that completed at or after
+   UNTIL_PERIOD, waiting if necessary.  */
+static struct vg_activity_info
+stats (uintptr_t until_period)
+{
+  struct vg_activity_info info;
+  error_t err = vg_activity_info (activity, activity, vg_activity_info_stats,
+				  until_period, &info);
+  assert (err == 0);
+  assert (info.event == vg_activity_info_stats);
+  assert (info.stats.count >= 1);
+
+  return info;
+}
+
+/* Return the number of faults taken in the periods after START.  */
+static int
+faults_since (uintptr_t start)
+{
+  /* Wait for the period during which the scan ended to complete.  */
+  uintptr_t end = stats (0).stats.stats[0].period;
+  struct vg_activity_info info = stats (end + 1);
+
+  if (info.stats.stats[info.stats.count - 1].period > start + 1)
+    printf ("Scan took more than %d periods: fault count is incomplete.\n",
+	    info.stats.count);
+
+  int faults = 0;
+  int i;
+  for (i = 0; i < info.stats.count; i ++)
+    if (info.stats.stats[i].period > start)
+      faults += info.stats.stats[i].faults;
+
+  return faults;
+}
+
+int
+main (int argc, char *argv[])
+{
+  activity = __hurd_startup_data->activity;
+
+  printf ("%s running...\n", argv[0]);
+
+  char *buffer = mmap (0, SIZE, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED)
+    {
+      printf ("Failed to allocate %d MB buffer.\n", SIZE / 1024 / 1024);
+      return 1;
+    }
+
+  const char *passes[] = { "write", "read" };
+  int pass;
+  for (pass = 0; pass < 2; pass ++)
+    {
+      /* Start with a fresh period.  */
+      uintptr_t start = stats (0).stats.stats[0].period;
+      start = stats (start + 1).stats.stats[0].period;
+
+      volatile int sum = 0;
+      int i;
+      for (i = 0; i < SIZE; i += PAGESIZE)
+	if (pass == 0)
+	  buffer[i] = i / PAGESIZE;
+	else
+	  sum += buffer[i];
+
+      int faults = faults_since (start);
+      printf ("%s: %d pages, %d faults (%d pages per fault)\n",
+	      passes[pass], SIZE / PAGESIZE, faults,
+	      faults ? (SIZE / PAGESIZE) / faults : 0);
+      printf ("read ahead: %d faults, %d pages hit, %d pages wasted\n",
+	      map_readahead_stats.faults, map_readahead_stats.hits,
+	      map_readahead_stats.wasted);
+    }
+
+  munmap (buffer, SIZE);
+
+  printf ("Done!\n");
+
+  return 0;
+}
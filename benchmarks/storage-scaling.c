@@ -0,0 +1,112 @@
+/* Measure storage allocation throughput as the number of allocating
+   threads grows.
+
+   For T = 1, 2, 4, 8 and 16, T threads each map ROUNDS regions of
+   PAGES anonymous pages, touch every page (which allocates a page of
+   storage) and unmap the region again (which frees it).  The
+   aggregate number of page allocations per second is printed for each
+   T.  */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include <hurd/stddef.h>
+
+/* The maximum number of allocating threads.  */
+#define THREADS 16
+
+/* The number of regions each thread maps.  */
+#define ROUNDS 64
+
+/* The number of pages in each region.  */
+#define PAGES 32
+
+static inline uint64_t
+now (void)
+{
+  struct timeval t;
+  struct timezone tz;
+
+  if (gettimeofday (&t, &tz) == -1)
+    return 0;
+  return (t.tv_sec * 1000000ULL + t.tv_usec);
+}
+
+/* The number of threads that have yet to start allocating.  The
+   threads spin until it drops to zero so that they start at about the
+   same time.  */
+static volatile int waiting;
+
+static void *
+worker (void *arg)
+{
+  __sync_fetch_and_add (&waiting, -1);
+  while (waiting > 0)
+    ;
+
+  int r;
+  for (r = 0; r < ROUNDS; r ++)
+    {
+      char *buffer = mmap (0, PAGES * PAGESIZE, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      assert (buffer != MAP_FAILED);
+
+      int i;
+      for (i = 0; i < PAGES; i ++)
+	buffer[i * PAGESIZE] = i;
+
+      munmap (buffer, PAGES * PAGESIZE);
+    }
+
+  return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+  printf ("%s running...\n", argv[0]);
+
+  printf ("threads\tpages\tus\tpages/s\n");
+
+  int t;
+  for (t = 1; t <= THREADS; t *= 2)
+    {
+      pthread_t threads[THREADS];
+
+      waiting = t;
+
+      int i;
+      for (i = 0; i < t; i ++)
+	{
+	  int err = pthread_create (&threads[i], NULL, worker, NULL);
+	  if (err)
+	    {
+	      printf ("Failed to create thread: %s\n", strerror (err));
+	      return 1;
+	    }
+	}
+
+      while (waiting > 0)
+	;
+      uint64_t start = now ();
+
+      for (i = 0; i < t; i ++)
+	pthread_join (threads[i], NULL);
+
+      uint64_t us = now () - start;
+      int pages = t * ROUNDS * PAGES;
+      printf ("%d\t%d\t%lld\t%lld\n", t, pages, (long long) us,
+	      us ? (long long) pages * 1000000 / us : 0);
+    }
+
+  printf ("Done!\n");
+
+  return 0;
+}
@@ -136,6 +136,17 @@ struct hurd_utcb
 
   struct hurd_fault_catcher *catchers;
 
+  /* The folio from which the thread allocates storage (see
+     storage_alloc).  */
+  struct storage_desc *storage_reservation;
+
+  /* The thread's magazine of free message buffers (see
+     hurd_message_buffer_alloc).  */
+  struct hurd_message_buffer *message_buffers;
+  int message_buffers_count;
+  /* Set while the thread manipulates MESSAGE_BUFFERS.  */
+  bool message_buffers_busy;
+
   /* The alternate activation stack.  */
   void *alternate_stack;
   bool alternate_stack_inuse;
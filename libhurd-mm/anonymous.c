@@ -77,6 +77,10 @@ offset_compare (const uintptr_t *a, const uintptr_t *b)
 
 BTREE_CLASS (storage_desc, struct storage_desc,
 	     uintptr_t, offset, node, offset_compare, false)
+
+/* The maximum number of pages for which fault allocates storage using
+   a single call to storage_alloc_n.  */
+#define ALLOC_BATCH 16
 
 static error_t
 slab_alloc (void *hook, size_t size, void **ptr)
@@ -194,34 +198,6 @@ fault (struct pager *pager, uintptr_t offset, int count, bool read_only,
 	   "%x + %d pages <= %x",
 	   offset, count, pager->length);
 
-  if (count == 1 && ! anon->fill)
-    /* It's likely a real fault (and not advice).  Fault in multiple
-       pages, if possible.  */
-    {
-      /* Up to 8 prior to the fault location.  */
-      uintptr_t left = 8 * PAGESIZE;
-      if (left > offset)
-	left = offset;
-
-      /* And up to 16 following the fault location.  */
-      uintptr_t right = 16 * PAGESIZE;
-      if (right > anon->pager.length - (count * PAGESIZE + offset))
-	right = anon->pager.length - count * PAGESIZE - offset;
-
-      fault_addr -= left;
-      offset -= left;
-      count = (left + PAGESIZE + right) / PAGESIZE;
-
-      assertx (offset + count * PAGESIZE <= pager->length,
-	       "%x + %d pages <= %x",
-	       offset, count, pager->length);
-
-      debug (5, "Faulting %p - %p (%d pages; %d kb); pager at " VG_ADDR_FMT "+%d",
-	     (void *) fault_addr, (void *) fault_addr + count * PAGE_SIZE,
-	     count, count * PAGESIZE / 1024,
-	     VG_ADDR_PRINTF (anon->map_area), offset);
-    }
-
   pages = __builtin_alloca (sizeof (void *) * count);
 
   if (! (anon->flags & ANONYMOUS_NO_ALLOC))
@@ -282,6 +258,12 @@ fault (struct pager *pager, uintptr_t offset, int count, bool read_only,
 	  }
       }
 
+      /* Storage that has been allocated for the pages following the
+	 current page but not yet used.  */
+      struct storage batch[ALLOC_BATCH];
+      int batch_count = 0;
+      int batch_next = 0;
+
       int i;
       for (i = 0; i < count; i ++)
 	{
@@ -319,10 +301,26 @@ fault (struct pager *pager, uintptr_t offset, int count, bool read_only,
 
 	      profile_region ("storage alloc");
 
-	      struct storage storage
-		= storage_alloc (anon->activity,
-				 vg_cap_page, STORAGE_UNKNOWN, anon->policy,
-				 VG_ADDR_VOID);
+	      if (batch_next == batch_count)
+		/* Allocate storage for this page and for the following
+		   pages that also do not yet have any.  */
+		{
+		  int n = 1;
+		  while (n < ALLOC_BATCH && i + n < count)
+		    {
+		      uintptr_t next = o + n * PAGESIZE;
+		      if (hurd_btree_storage_desc_find (storage_descs, &next))
+			break;
+		      n ++;
+		    }
+
+		  batch_count = storage_alloc_n (anon->activity, vg_cap_page,
+						 STORAGE_UNKNOWN, anon->policy,
+						 VG_ADDR_VOID, n, batch);
+		  batch_next = 0;
+		}
+
+	      struct storage storage = batch[batch_next ++];
 	      if (VG_ADDR_IS_VOID (storage.addr))
 		panic ("Out of memory.");
 	      storage_desc->storage = storage.addr;
@@ -660,6 +658,10 @@ anonymous_pager_alloc (vg_addr_t activity,
   anon->pager.fault = fault;
   anon->pager.no_refs = destroy;
   anon->pager.advise = advise;
+  /* map_fault decides how many pages to fault in at once.  A fill
+     function, however, expects to be called for the faulting page
+     only.  */
+  anon->pager.readahead = ! fill;
 
   anon->activity = activity;
   anon->flags = flags;
@@ -62,7 +62,7 @@ as_lookup_rel_internal (vg_activity_t activity,
 			struct vg_cap *root, vg_addr_t address,
 			enum vg_cap_type type, bool *writable,
 			enum as_lookup_mode mode, union as_lookup_ret *rt,
-			bool dump)
+			struct as_lookup_cache *cache, bool dump)
 {
   assert (root);
 
@@ -196,7 +196,8 @@ as_lookup_rel_internal (vg_activity_t activity,
 		return false;
 	      }
 
-	    int offset = VG_CAP_SUBPAGE_OFFSET (root)
+	    int subpage_offset = VG_CAP_SUBPAGE_OFFSET (root);
+	    int offset = subpage_offset
 	      + extract_bits64_inv (addr, remaining - 1, bits);
 	    assert (0 <= offset && offset < VG_CAPPAGE_SLOTS);
 	    remaining -= bits;
@@ -206,6 +207,20 @@ as_lookup_rel_internal (vg_activity_t activity,
 		     offset, bits, remaining);
 
 	    root = &object->caps[offset];
+
+	    if (cache && remaining == 0)
+	      /* ROOT is a slot in OBJECT.  Remember OBJECT.  */
+	      {
+		cache->object = object;
+#ifdef RM_INTERN
+		cache->oid = object_to_object_desc (object)->oid;
+#endif
+		cache->root = start;
+		cache->prefix = vg_addr_chop (address, bits);
+		cache->bits = bits;
+		cache->offset = subpage_offset;
+		cache->writable = w;
+	      }
 	    break;
 	  }
 
@@ -403,7 +418,54 @@ as_lookup_rel (vg_activity_t activity,
 #endif
   r = as_lookup_rel_internal (activity,
 			      root, address, type, writable, mode, rt,
-			      false);
+			      NULL, false);
+#ifdef RM_INTERN
+  profile_region_end ();
+#endif
+
+  return r;
+}
+
+bool
+as_lookup_rel_cached (vg_activity_t activity,
+		      struct vg_cap *root, vg_addr_t address,
+		      enum vg_cap_type type, bool *writable,
+		      enum as_lookup_mode mode, union as_lookup_ret *rt,
+		      struct as_lookup_cache *cache)
+{
+  if (type == -1 && mode != as_lookup_want_object
+      && cache->object && cache->root == root
+      && vg_addr_depth (address) == vg_addr_depth (cache->prefix) + cache->bits
+      && VG_ADDR_EQ (vg_addr_chop (address, cache->bits), cache->prefix)
+#ifdef RM_INTERN
+      && object_to_object_desc (cache->object)->live
+      && object_to_object_desc (cache->object)->oid == cache->oid
+#endif
+      )
+    /* ADDR designates a slot in the cached capability page.  */
+    {
+      struct vg_cap *slot
+	= &cache->object->caps[cache->offset
+			       + vg_addr_extract (address, cache->bits)];
+
+      if (writable)
+	*writable = cache->writable;
+
+      if (mode == as_lookup_want_slot)
+	rt->capp = slot;
+      else
+	rt->cap = *slot;
+      return true;
+    }
+
+  bool r;
+
+#ifdef RM_INTERN
+  profile_region (NULL);
+#endif
+  r = as_lookup_rel_internal (activity,
+			      root, address, type, writable, mode, rt,
+			      cache, false);
 #ifdef RM_INTERN
   profile_region_end ();
 #endif
@@ -419,5 +481,5 @@ as_dump_path_rel (vg_activity_t activity, struct vg_cap *root, vg_addr_t addr)
   as_lookup_rel_internal (activity,
 			  root, addr, -1,
 			  NULL, as_lookup_want_cap, &rt,
-			  true);
+			  NULL, true);
 }
@@ -64,7 +64,11 @@ vg_thread_id_t as_rwlock_owner;
    The maximum number of free regions is the number of allocated
    regions plus one.  As each free region requires a constant amount
    of memory, the memory required to maintain the free regions is
-   O(number of allocated regions).  */
+   O(number of allocated regions).
+
+   To find a region of a particular size without walking the whole
+   tree, each free region is also on one of a number of segregated
+   lists according to its size (see free_space_class).  */
 struct region
 {
   uint64_t start;
@@ -75,6 +79,11 @@ struct free_space
 {
   hurd_btree_node_t node;
   struct region region;
+
+  /* The size class list that the region is on.  */
+  struct free_space *next;
+  struct free_space **prevp;
+  int size_class;
 };
 
 /* Compare two regions.  Two regions are considered equal if there is
@@ -97,6 +106,80 @@ BTREE_CLASS (free_space, struct free_space, struct region, region, node,
 static ss_mutex_t free_spaces_lock;
 static hurd_btree_free_space_t free_spaces;
 
+/* The free regions by size.  A region of SIZE bytes is on list
+   vg_msb64 (SIZE - 1), i.e., list C holds the regions with at least
+   2^(C-1)+1 and at most 2^C bytes.  The last list also holds any
+   larger regions.  Bit C of FREE_SPACE_CLASS_MASK is set if list C
+   is not empty.  Protected by FREE_SPACES_LOCK.  */
+#define FREE_SPACE_CLASSES 64
+static struct free_space *free_space_classes[FREE_SPACE_CLASSES];
+static uint64_t free_space_class_mask;
+
+/* The number of regions that as_alloc examines on a list whose
+   regions are not all large enough before moving on to a list whose
+   regions are.  */
+#define FREE_SPACE_PROBES 8
+
+static int
+free_space_class (uint64_t start, uint64_t end)
+{
+  int c = vg_msb64 (end - start);
+  return c < FREE_SPACE_CLASSES ? c : FREE_SPACE_CLASSES - 1;
+}
+
+/* Add F to the list corresponding to its size.  */
+static void
+free_space_class_link (struct free_space *f)
+{
+  assert (! ss_mutex_trylock (&free_spaces_lock));
+
+  int c = free_space_class (f->region.start, f->region.end);
+
+  f->size_class = c;
+  f->next = free_space_classes[c];
+  if (f->next)
+    f->next->prevp = &f->next;
+  f->prevp = &free_space_classes[c];
+  free_space_classes[c] = f;
+
+  free_space_class_mask |= 1ULL << c;
+}
+
+static void
+free_space_class_unlink (struct free_space *f)
+{
+  assert (! ss_mutex_trylock (&free_spaces_lock));
+  assert (f->prevp);
+
+  *f->prevp = f->next;
+  if (f->next)
+    f->next->prevp = f->prevp;
+
+  if (! free_space_classes[f->size_class])
+    free_space_class_mask &= ~(1ULL << f->size_class);
+
+#ifndef NDEBUG
+  /* Try to detect multiple unlink.  */
+  f->next = NULL;
+  f->prevp = NULL;
+#endif
+}
+
+/* Change the extent of the free region F to START-END.  F may not
+   overlap with any other free region.  */
+static void
+free_space_resize (struct free_space *f, uint64_t start, uint64_t end)
+{
+  f->region.start = start;
+  f->region.end = end;
+
+  if (free_space_class (start, end) != f->size_class)
+    {
+      free_space_class_unlink (f);
+      free_space_class_link (f);
+    }
+}
+
 static struct hurd_slab_space free_space_desc_slab;
 
 static error_t
@@ -154,29 +237,60 @@ free_space_split (struct free_space *f, uint64_t start, uint64_t end)
   if (start == f->region.start && end == f->region.end)
     /* We completely consume the free region.  Remove it.  */
     {
+      free_space_class_unlink (f);
       hurd_btree_free_space_detach (&free_spaces, f);
       free_space_desc_free (f);
     }
   else if (start == f->region.start)
     /* We overlap with the start of the region, just shrink it.  */
-    f->region.start = end + 1;
+    free_space_resize (f, end + 1, f->region.end);
   else if (end == f->region.end)
     /* We overlap with the end of the region, just shrink it.  */
-    f->region.end = start - 1;
+    free_space_resize (f, f->region.start, start - 1);
   else
     /* We split the region.  */
     {
       struct free_space *new = free_space_desc_alloc ();
       new->region.start = end + 1;
       new->region.end = f->region.end;
-      f->region.end = start - 1;
+      free_space_resize (f, f->region.start, start - 1);
 
       struct free_space *f = hurd_btree_free_space_insert (&free_spaces, new);
       if (f)
 	debug (1, "%llx-%llx overlaps with %llx-%llx",
 	       start, end, f->region.start, f->region.end);
       assert (! f);
+
+      free_space_class_link (new);
+    }
+}
+
+/* Return the first region on the list starting with F that can hold
+   LENGTH bytes starting at a multiple of ALIGN.  Examine at most MAX
+   regions (if -1, then all of them).  If DATA_MAPPABLE is true, the
+   bytes must be below DATA_ADDR_MAX.  On success, the start of the
+   bytes is returned in *STARTP.  */
+static struct free_space *
+free_space_fit (struct free_space *f, uint64_t align, uint64_t length,
+		bool data_mappable, int max, uint64_t *startp)
+{
+  for (; f && max != 0; f = f->next, max --)
+    {
+      uint64_t start = (f->region.start + align - 1) & ~(align - 1);
+      if (start < f->region.start)
+	/* Overflow.  */
+	continue;
+
+      if (start <= f->region.end
+	  && length - 1 <= f->region.end - start
+	  && ! (data_mappable && start + length - 1 >= DATA_ADDR_MAX))
+	{
+	  *startp = start;
+	  return f;
+	}
     }
+
+  return NULL;
 }
 
 vg_addr_t
@@ -210,27 +324,50 @@ as_alloc (int width, uint64_t count, bool data_mappable)
 
   vg_addr_t addr = VG_ADDR_VOID;
 
-  struct free_space *free_space;
-  for (free_space = hurd_btree_free_space_first (&free_spaces);
-       free_space;
-       free_space = hurd_btree_free_space_next (free_space))
+  /* Any region with at least LENGTH + ALIGN - 1 bytes can hold the
+     allocation.  The regions on lists GUARANTEED and up are at least
+     that large.  The regions on the lists from SMALLEST up to
+     GUARANTEED are at least LENGTH bytes large, but whether one fits
+     depends on its alignment.  Prefer them, as they are the better
+     fit, but to bound the search, only examine a few of them before
+     taking the first region from the smallest non-empty list that
+     certainly fits.  Only if there is none do we scan the rest.  */
+  uint64_t need = length + align - 2;
+  if (need < length)
+    /* Overflow.  */
+    need = -1ULL;
+  int guaranteed = vg_msb64 (need) + 1;
+  if (guaranteed > FREE_SPACE_CLASSES)
+    guaranteed = FREE_SPACE_CLASSES;
+  int smallest = vg_msb64 (length - 1);
+  if (smallest > guaranteed)
+    smallest = guaranteed;
+
+  struct free_space *free_space = NULL;
+  uint64_t start;
+  int c;
+  for (c = smallest; ! free_space && c < guaranteed; c ++)
+    free_space = free_space_fit (free_space_classes[c], align, length,
+				 data_mappable, FREE_SPACE_PROBES, &start);
+
+  uint64_t mask = 0;
+  if (guaranteed < FREE_SPACE_CLASSES)
+    mask = free_space_class_mask & (-1ULL << guaranteed);
+  for (; ! free_space && mask; mask &= mask - 1)
+    /* The first region fits unless the caller wants data mappable
+       memory and the region is above DATA_ADDR_MAX.  */
+    free_space = free_space_fit (free_space_classes[vg_lsb64 (mask) - 1],
+				 align, length, data_mappable, -1, &start);
+
+  for (c = smallest; ! free_space && c < guaranteed; c ++)
+    free_space = free_space_fit (free_space_classes[c], align, length,
+				 data_mappable, -1, &start);
+
+  if (free_space)
+    /* We found a fit!  */
     {
-      uint64_t start;
-      start = (free_space->region.start + align - 1) & ~(align - 1);
-
-      if (start < free_space->region.end
-	  && length <= (free_space->region.end - start) + 1)
-	/* We found a fit!  */
-	{
-	  if (data_mappable && start + length - 1 >= DATA_ADDR_MAX)
-	    /* But it must be mappable and it extends beyond the end
-	       of the address space!  */
-	    break;
-
-	  free_space_split (free_space, start, start + length - 1);
-	  addr = VG_ADDR (start, VG_ADDR_BITS - (w - shift));
-	  break;
-	}
+      free_space_split (free_space, start, start + length - 1);
+      addr = VG_ADDR (start, VG_ADDR_BITS - (w - shift));
     }
 
   ss_mutex_unlock (&free_spaces_lock);
@@ -309,17 +446,20 @@ as_free (vg_addr_t addr, uint64_t count)
 	  && prev->region.end + 1 == start && end + 1 == next->region.start)
 	/* We exactly fill a hole and have to free one.  */
 	{
-	  prev->region.end = next->region.end;
+	  uint64_t next_end = next->region.end;
+	  free_space_class_unlink (next);
 	  hurd_btree_free_space_detach (&free_spaces, next);
 	  free_space_desc_free (next);
+
+	  free_space_resize (prev, prev->region.start, next_end);
 	}
       else if (prev && prev->region.end + 1 == start)
-	prev->region.end = end;
+	free_space_resize (prev, prev->region.start, end);
       else
 	{
 	  assert (next);
 	  assert (end + 1 == next->region.start);
-	  next->region.start = start;
+	  free_space_resize (next, start, next->region.end);
 	}
     }
   else
@@ -327,6 +467,7 @@ as_free (vg_addr_t addr, uint64_t count)
     {
       space->region.start = start;
       space->region.end = end;
+      free_space_class_link (space);
     }
 
   ss_mutex_unlock (&free_spaces_lock);
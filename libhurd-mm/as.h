@@ -501,6 +501,52 @@ extern bool as_lookup_rel (vg_activity_t activity,
 			   enum as_lookup_mode mode,
 			   union as_lookup_ret *ret);
 
+/* A cache of the capability page indexed by the last look up to end
+   in a capability page slot.  See as_lookup_rel_cached.  */
+struct as_lookup_cache
+{
+  /* The capability page.  NULL if the cache is empty.  */
+  struct vg_object *object;
+#ifdef RM_INTERN
+  /* The capability page's OID, to detect that it has been
+     evicted.  */
+  vg_oid_t oid;
+#endif
+  /* The root of the address space.  */
+  struct vg_cap *root;
+  /* The address of the capability page, i.e., the address of the
+     slot without the BITS bits that index the page.  */
+  vg_addr_t prefix;
+  int bits;
+  /* The subpage's offset in the capability page.  */
+  int offset;
+  /* Whether the slots are writable.  */
+  bool writable;
+};
+
+static inline void
+as_lookup_cache_flush (struct as_lookup_cache *cache)
+{
+  cache->object = NULL;
+}
+
+/* Like as_lookup_rel, but if TYPE is -1, MODE is not
+   as_lookup_want_object and ADDR designates a slot in the capability
+   page cached in CACHE, the slot is returned without walking the
+   address space.  Otherwise, the address space is walked and, if the
+   walk ends in a capability page slot, CACHE is updated.
+
+   This is useful when looking up many slots that are likely to be in
+   the same capability page.  The caller must flush CACHE using
+   as_lookup_cache_flush if it changes a capability that is used to
+   translate the cached capability page.  */
+extern bool as_lookup_rel_cached (vg_activity_t activity,
+				  struct vg_cap *as_root_cap, vg_addr_t addr,
+				  enum vg_cap_type type, bool *writable,
+				  enum as_lookup_mode mode,
+				  union as_lookup_ret *ret,
+				  struct as_lookup_cache *cache);
+
 
 /* Lookup the slot at address ADDR in the address space rooted at
    ROOT.  On success, execute the code CODE.  Whether the slot is
@@ -867,6 +867,9 @@ hurd_activation_state_free (struct hurd_utcb *utcb)
   assert (utcb->canary1 == UTCB_CANARY1);
   assert (! utcb->activation_stack);
 
+  storage_reservation_release (utcb);
+  hurd_message_buffer_cache_release (utcb);
+
   /* Free any activation frames.  */
   struct activation_frame *f;
   struct activation_frame *prev = utcb->activation_stack_bottom;
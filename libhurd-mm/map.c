@@ -25,8 +25,10 @@
 #include <hurd/storage.h>
 #include <hurd/as.h>
 #include <hurd/slab.h>
+#include <viengoos/misc.h>
 
 #include <string.h>
+#include <sched.h>
 
 #include "map.h"
 #include "pager.h"
@@ -72,10 +74,19 @@ map_alloc (void)
   return buffer;
 }
 
+/* Maps that have been freed but may still be referenced by a thread
+   that is looking up a map using the map index.  */
+static struct map *maps_retired;
+
 static void
-map_free (struct map *storage)
+map_free (struct map *map)
 {
-  hurd_slab_dealloc (&map_slab, storage);
+  /* This may be called without MAPS_LOCK.  maps_index_publish takes
+     the whole list at once, so a plain compare and swap is safe.  */
+  do
+    map->retired_next = maps_retired;
+  while (__sync_val_compare_and_swap (&maps_retired, map->retired_next, map)
+	 != map->retired_next);
 }
 
 static void
@@ -107,6 +118,214 @@ list_unlink (struct map *e)
 ss_mutex_t maps_lock;
 hurd_btree_map_t maps;
 
+/* A map index entry.  The fields are copies of the map's fields at
+   the time the index was built.  */
+struct map_index_entry
+{
+  struct region region;
+  uintptr_t offset;
+  struct pager *pager;
+  enum map_access access;
+  /* Only used to access the map's read ahead state.  */
+  struct map *map;
+};
+
+#define MAP_INDEX_LEAF_ENTRIES \
+  (PAGESIZE / sizeof (struct map_index_entry))
+
+/* A map index occupies a page and references up to MAP_INDEX_LEAVES
+   pages of entries.  The entries are sorted by address.  Entry I is
+   entry I % MAP_INDEX_LEAF_ENTRIES of leaf I / MAP_INDEX_LEAF_ENTRIES.
+   An index is not modified while it is published or a reader may
+   still reference it.  */
+struct map_index
+{
+  /* The number of entries.  */
+  int count;
+  /* The number of leaves allocated.  */
+  int leaf_count;
+  struct map_index_entry *leaves[];
+};
+
+#define MAP_INDEX_LEAVES \
+  ((PAGESIZE - sizeof (struct map_index)) \
+   / sizeof (struct map_index_entry *))
+
+/* The published index.  NULL if it was retracted because MAPS
+   changed and it has not yet been rebuilt, or if there are too many
+   maps to index.  In either case, map_fault takes MAPS_LOCK.  */
+static struct map_index *maps_index;
+
+/* Whether MAPS_INDEX reflects MAPS.  If not, the next call to
+   map_fault that takes MAPS_LOCK builds and publishes a new index.
+   Thus, a series of changes to MAPS costs a single rebuild.  */
+static bool maps_index_current;
+
+/* The buffer in which the index is built.  The index is only built
+   when none is published and retracting it waits until no reader
+   references it, so one buffer suffices.  The buffer keeps its
+   leaves: building an index only allocates memory when the number
+   of maps grows.  */
+static struct map_index *maps_index_buffer;
+
+bool maps_index_stale;
+
+/* Readers announce themselves by incrementing the reader count
+   corresponding to the parity of MAPS_INDEX_EPOCH.  After retracting
+   the index, a writer increments the epoch and waits for the reader
+   count of the old epoch to drop to zero.  A reader that announced
+   itself in the new epoch necessarily sees that there is no
+   index.  */
+static volatile int maps_index_epoch;
+static volatile int maps_index_readers[2];
+
+static int
+maps_index_read_lock (void)
+{
+  for (;;)
+    {
+      int e = maps_index_epoch & 1;
+      __sync_fetch_and_add (&maps_index_readers[e], 1);
+      if ((maps_index_epoch & 1) == e)
+	return e;
+      __sync_fetch_and_add (&maps_index_readers[e], -1);
+    }
+}
+
+static void
+maps_index_read_unlock (int e)
+{
+  __sync_fetch_and_add (&maps_index_readers[e], -1);
+}
+
+static struct map_index_entry *
+map_index_entry (struct map_index *index, int i)
+{
+  return &index->leaves[i / MAP_INDEX_LEAF_ENTRIES][i % MAP_INDEX_LEAF_ENTRIES];
+}
+
+/* Return the entry of the map that covers ADDR, or NULL if there is
+   none.  */
+static struct map_index_entry *
+map_index_find (struct map_index *index, uintptr_t addr)
+{
+  int lo = 0;
+  int hi = index->count;
+  while (lo < hi)
+    {
+      int mid = lo + (hi - lo) / 2;
+      struct map_index_entry *e = map_index_entry (index, mid);
+
+      if (addr < e->region.start)
+	hi = mid;
+      else if (addr - e->region.start >= e->region.length)
+	lo = mid + 1;
+      else
+	return e;
+    }
+
+  return NULL;
+}
+
+/* Build an index of MAPS in the index buffer.  Returns NULL if there
+   are too many maps.  */
+static struct map_index *
+map_index_build (void)
+{
+  assert (! ss_mutex_trylock (&maps_lock));
+  assert (! maps_index);
+
+  void *page;
+  struct map_index *index = maps_index_buffer;
+  if (unlikely (! index))
+    {
+      slab_alloc (NULL, PAGESIZE, &page);
+      index = page;
+      index->leaf_count = 0;
+      maps_index_buffer = index;
+    }
+  index->count = 0;
+
+  struct map *map;
+  for (map = hurd_btree_map_first (&maps);
+       map;
+       map = hurd_btree_map_next (map))
+    {
+      if (index->count == index->leaf_count * MAP_INDEX_LEAF_ENTRIES)
+	/* The leaves are full.  */
+	{
+	  if (index->leaf_count == MAP_INDEX_LEAVES)
+	    {
+	      debug (0, "Too many maps to index.");
+	      return NULL;
+	    }
+
+	  slab_alloc (NULL, PAGESIZE, &page);
+	  index->leaves[index->leaf_count ++] = page;
+	}
+
+      struct map_index_entry *e = map_index_entry (index, index->count ++);
+      e->region = map->region;
+      e->offset = map->offset;
+      e->pager = map->pager;
+      e->access = map->access;
+      e->map = map;
+    }
+
+  return index;
+}
+
+/* Build an index of MAPS and publish it.  The caller must hold
+   MAPS_LOCK and no index may be published.  */
+static void
+maps_index_publish (void)
+{
+  assert (! ss_mutex_trylock (&maps_lock));
+
+  struct map_index *index = map_index_build ();
+  __sync_synchronize ();
+
+  maps_index = index;
+  maps_index_current = true;
+}
+
+void
+maps_index_retract (void)
+{
+  assert (! ss_mutex_trylock (&maps_lock));
+
+  maps_index_stale = false;
+  maps_index_current = false;
+
+  /* Any maps retired so far are no longer connected.  They are not in
+     any index built from now on.  */
+  struct map *retired = __sync_lock_test_and_set (&maps_retired, NULL);
+
+  if (! maps_index && ! retired)
+    /* No reader can reference an index: there is nothing to wait
+       for.  */
+    return;
+
+  maps_index = NULL;
+  __sync_synchronize ();
+
+  int e = maps_index_epoch & 1;
+  maps_index_epoch ++;
+  __sync_synchronize ();
+
+  /* Wait for any readers that may have seen the old index.  Readers
+     do not block, so this is short.  */
+  while (maps_index_readers[e] > 0)
+    sched_yield ();
+
+  while (retired)
+    {
+      struct map *next = retired->retired_next;
+      hurd_slab_dealloc (&map_slab, retired);
+      retired = next;
+    }
+}
+
 static bool
 map_install (struct map *map)
 {
@@ -144,6 +363,7 @@ map_install (struct map *map)
       return false;
     }
   map->connected = true;
+  maps_index_stale = true;
 
   /* Attach to its pager.  */
   list_link (&map->pager->maps, map);
@@ -188,6 +408,7 @@ map_disconnect (struct map *map)
   assert (map->connected);
   hurd_btree_map_detach (&maps, map);
   map->connected = false;
+  maps_index_stale = true;
 }
 
 void
@@ -308,10 +529,135 @@ map_join (struct map *first, struct map *second)
 
   /* We can only update this after we detach SECOND from the tree.  */
   first->offset += length;
+  maps_index_stale = true;
 
   return true;
 }
 
+struct map_readahead_stats map_readahead_stats;
+
+/* Update the read ahead state RA of a map that covers the offsets
+   [FIRST, END) of its pager for a fault at offset OFFSET and return
+   the number of pages to fault in.  The pages are at *START, *START +
+   *STRIDE, etc.
+
+   The caller need not hold MAPS_LOCK.  Concurrent faults on the same
+   map may thus interleave their updates.  As the state is only a
+   hint, this is harmless: the returned pages are always within
+   [FIRST, END).  */
+static int
+map_readahead (struct map_readahead *ra, uintptr_t first, uintptr_t end,
+	       uintptr_t offset, uintptr_t *start, intptr_t *stride)
+{
+  intptr_t delta = offset - ra->last;
+
+  if (ra->window == 0)
+    /* The first fault.  Assume that it is the start of a forward
+       sequential stream.  */
+    {
+      ra->window = MAP_READAHEAD_INITIAL;
+      ra->stride = PAGESIZE;
+    }
+  else if (offset == ra->next)
+    /* The stream continues.  */
+    {
+      __sync_fetch_and_add (&map_readahead_stats.hits, ra->prefaulted);
+
+      ra->window *= 2;
+      if (ra->window > MAP_READAHEAD_MAX)
+	ra->window = MAP_READAHEAD_MAX;
+    }
+  else
+    {
+      __sync_fetch_and_add (&map_readahead_stats.wasted, ra->prefaulted);
+
+      if (delta != 0 && delta == ra->delta)
+	/* A new stream.  */
+	{
+	  ra->window = MAP_READAHEAD_INITIAL;
+	  ra->stride = delta;
+	}
+      else
+	{
+	  ra->window /= 2;
+	  if (ra->window == 0)
+	    ra->window = 1;
+
+	  ra->stride = delta == -PAGESIZE ? -PAGESIZE : PAGESIZE;
+	}
+    }
+
+  __sync_fetch_and_add (&map_readahead_stats.faults, 1);
+  ra->delta = delta;
+  ra->last = offset;
+
+  /* Read the window and the stride once: another thread may be
+     changing them.  */
+  int count = ra->window;
+  if (count < 1)
+    count = 1;
+  if (count > MAP_READAHEAD_MAX)
+    count = MAP_READAHEAD_MAX;
+  intptr_t s = ra->stride;
+
+  if (s == PAGESIZE)
+    {
+      if (count > (end - offset) / PAGESIZE)
+	count = (end - offset) / PAGESIZE;
+
+      *start = offset;
+      ra->next = offset + count * PAGESIZE;
+    }
+  else if (s == -PAGESIZE)
+    {
+      if (count > (offset - first) / PAGESIZE + 1)
+	count = (offset - first) / PAGESIZE + 1;
+
+      *start = offset - (count - 1) * PAGESIZE;
+      ra->next = *start - PAGESIZE;
+    }
+  else
+    {
+      if (count > MAP_READAHEAD_STRIDED_MAX)
+	count = MAP_READAHEAD_STRIDED_MAX;
+
+      int i;
+      for (i = 1; i < count; i ++)
+	{
+	  uintptr_t o = offset + i * s;
+	  if (o < first || o >= end
+	      || (s > 0) != (o > offset))
+	    /* Out of range (or wrapped around).  */
+	    break;
+	}
+      count = i;
+
+      *start = offset;
+      ra->next = offset + count * s;
+    }
+
+  assert (count >= 1);
+  ra->prefaulted = count - 1;
+  *stride = s;
+
+  return count;
+}
+
+/* Ask Viengoos to map the COUNT pages starting at ADDR.  */
+static void
+map_prefault (uintptr_t addr, int count)
+{
+  int faulted;
+  int i;
+  for (i = 0; i < count; i += faulted)
+    {
+      error_t err = vg_fault (VG_ADDR_VOID, VG_ADDR_VOID, addr + i * PAGESIZE,
+			      count - i, &faulted);
+      if (err || faulted == 0)
+	break;
+    }
+}
+
 bool
 map_fault (vg_addr_t fault_addr, uintptr_t ip, struct vg_activation_fault_info info)
 {
@@ -324,47 +670,139 @@ map_fault (vg_addr_t fault_addr, uintptr_t ip, struct vg_activation_fault_info i
   region.start = (uintptr_t) VG_ADDR_TO_PTR (fault_addr);
   region.length = 1;
 
-  maps_lock_lock ();
+  struct map_index_entry entry;
+  int count = 1;
+  uintptr_t start;
+  intptr_t stride = PAGESIZE;
+
+  /* Check that the map described by ENTRY grants the access and
+     determine the pages to fault in.  ENTRY.MAP must not be freed
+     concurrently.  If REPORT is true, report an invalid access.  */
+  bool prepare (bool report)
+  {
+    /* Note: write access implies read access.  */
+    if (((info.access & VG_WRITE) && ! (entry.access & MAP_ACCESS_WRITE))
+	|| ! entry.access)
+      {
+	if (report)
+	  debug (0, "Invalid %s access at " VG_ADDR_FMT ": " MAP_FMT,
+		 info.access & VG_WRITE ? "write" : "read",
+		 VG_ADDR_PRINTF (fault_addr), MAP_PRINTF (&entry));
+	return false;
+      }
+
+    start = entry.offset + (region.start - entry.region.start);
+    if (entry.pager->readahead)
+      {
+	uintptr_t end = entry.offset + entry.region.length;
+	if (end > entry.pager->length)
+	  end = entry.pager->length;
+
+	count = map_readahead (&entry.map->readahead, entry.offset, end,
+			       start & ~(PAGESIZE - 1), &start, &stride);
+      }
+
+    return true;
+  }
+
+  /* Look up the map using the index.  */
+  int e = maps_index_read_lock ();
+  struct map_index *index = maps_index;
+  struct map_index_entry *ep = NULL;
+  if (likely (!! index))
+    ep = map_index_find (index, region.start);
+  bool found = false;
+  if (likely (!! ep))
+    {
+      entry = *ep;
+      found = prepare (false);
+    }
+  maps_index_read_unlock (e);
 
-  struct map *map = map_find (region);
-  if (! map)
+  if (unlikely (! found))
+    /* There is no map, the access is not allowed or there is no
+       index.  The index may be out of date: take MAPS_LOCK to be
+       sure.  */
     {
-      do_debug (5)
+      maps_lock_lock ();
+
+      if (! maps_index_current)
+	/* MAPS changed since the index was last built.  Rebuild it
+	   now rather than each time MAPS changes.  */
+	maps_index_publish ();
+
+      struct map *map = map_find (region);
+      if (! map)
 	{
-	  debug (0, "No map covers " VG_ADDR_FMT "(" VG_ACTIVATION_FAULT_INFO_FMT ")",
-		 VG_ADDR_PRINTF (fault_addr),
-		 VG_ACTIVATION_FAULT_INFO_PRINTF (info));
-	  for (map = hurd_btree_map_first (&maps);
-	       map;
-	       map = hurd_btree_map_next (map))
-	    debug (0, MAP_FMT, MAP_PRINTF (map));
+	  do_debug (5)
+	    {
+	      debug (0, "No map covers " VG_ADDR_FMT "("
+		     VG_ACTIVATION_FAULT_INFO_FMT ")",
+		     VG_ADDR_PRINTF (fault_addr),
+		     VG_ACTIVATION_FAULT_INFO_PRINTF (info));
+	      for (map = hurd_btree_map_first (&maps);
+		   map;
+		   map = hurd_btree_map_next (map))
+		debug (0, MAP_FMT, MAP_PRINTF (map));
+	    }
+
+	  maps_lock_unlock ();
+	  return false;
 	}
 
-      maps_lock_unlock ();
-      return false;
-    }
+      entry.region = map->region;
+      entry.offset = map->offset;
+      entry.pager = map->pager;
+      entry.access = map->access;
+      entry.map = map;
 
-  /* Note: write access implies read access.  */
-  if (((info.access & VG_WRITE) && ! (map->access & MAP_ACCESS_WRITE))
-      || ! map->access)
-    {
-      debug (0, "Invalid %s access at " VG_ADDR_FMT ": " MAP_FMT,
-	     info.access & VG_WRITE ? "write" : "read",
-	     VG_ADDR_PRINTF (fault_addr), MAP_PRINTF (map));
+      found = prepare (true);
 
       maps_lock_unlock ();
-      return false;
+
+      if (! found)
+	return false;
     }
 
-  struct pager *pager = map->pager;
-  uintptr_t offset = map->offset + (region.start - map->region.start);
-  bool ro = (map->access & MAP_ACCESS_WRITE) ? false : true;
+  struct pager *pager = entry.pager;
+  uintptr_t offset = entry.offset + (region.start - entry.region.start);
+  bool ro = (entry.access & MAP_ACCESS_WRITE) ? false : true;
 
-  maps_lock_unlock ();
+  /* The address corresponding to offset 0.  */
+  uintptr_t base = entry.region.start - entry.offset;
 
   /* Propagate the fault.  */
-  bool r = pager->fault (pager, offset, 1, ro,
-			 (uintptr_t) VG_ADDR_TO_PTR (fault_addr), ip, info);
+  bool r;
+  if (count == 1)
+    r = pager->fault (pager, offset, 1, ro,
+		      (uintptr_t) VG_ADDR_TO_PTR (fault_addr), ip, info);
+  else if (stride == PAGESIZE || stride == -PAGESIZE)
+    {
+      r = pager->fault (pager, start, count, ro, base + start, ip, info);
+      if (r)
+	map_prefault (base + start, count);
+    }
+  else
+    /* A strided stream.  Fault in the pages one at a time.  */
+    {
+      r = pager->fault (pager, start, 1, ro, base + start, ip, info);
+
+      int i;
+      for (i = 1; r && i < count; i ++)
+	{
+	  uintptr_t o = start + i * stride;
+	  if (! pager->fault (pager, o, 1, ro, base + o, ip, info))
+	    break;
+	  map_prefault (base + o, 1);
+	}
+    }
+
+  if (! r && count > 1)
+    /* Perhaps the pager could not provide the whole window.  Try just
+       the faulting page.  */
+    r = pager->fault (pager, offset, 1, ro,
+		      (uintptr_t) VG_ADDR_TO_PTR (fault_addr), ip, info);
+
   if (! r)
     debug (5, "Map did not resolve fault at " VG_ADDR_FMT,
 	   VG_ADDR_PRINTF (fault_addr));
@@ -85,6 +85,58 @@ enum map_access
 /* Call-back invoked when destroying a map.  */
 typedef void (*map_destroy_t) (struct map *map);
 
+/* When a map's pager supports it (see the readahead field of struct
+   pager), map_fault does not just fault in the page that was
+   accessed: it faults in a window of pages and then asks Viengoos to
+   map them (using vg_fault) so that accessing them does not fault
+   again.
+
+   The window adapts to the stream of faults seen by each map, in the
+   way Linux's read ahead does.  If a fault lands where the previous
+   one predicted the next fault would land (just past its window), the
+   stream is sequential (forward or backward) or strided and the
+   window is doubled, up to MAP_READAHEAD_MAX pages.  Otherwise, the
+   window is halved.  A stream is recognized when two consecutive
+   faults are the same distance apart.  For a strided stream, the
+   pages that are faulted in are the next pages in the stream (at most
+   MAP_READAHEAD_STRIDED_MAX of them).  */
+#define MAP_READAHEAD_INITIAL 4
+#define MAP_READAHEAD_MAX 32
+#define MAP_READAHEAD_STRIDED_MAX 8
+
+struct map_readahead
+{
+  /* The offset into the pager of the last fault.  */
+  uintptr_t last;
+  /* The distance between the last two faults.  */
+  intptr_t delta;
+  /* The distance between the pages faulted in by the last fault.
+     PAGESIZE or -PAGESIZE for sequential streams.  */
+  intptr_t stride;
+  /* Where we expect the next fault if the stream continues.  */
+  uintptr_t next;
+  /* The size of the window, in pages.  0 if the map has not yet
+     faulted.  */
+  int window;
+  /* The number of pages the last fault faulted in speculatively.  */
+  int prefaulted;
+};
+
+struct map_readahead_stats
+{
+  /* The number of faults handled with read ahead.  */
+  int faults;
+  /* The number of pages faulted in speculatively whose stream
+     continued past them.  */
+  int hits;
+  /* The number of pages faulted in speculatively whose stream did not
+     continue, which were therefore likely not used.  */
+  int wasted;
+};
+
+/* Updated atomically.  */
+extern struct map_readahead_stats map_readahead_stats;
+
 struct map
 {
   /* All fields are protected by the map_lock lock.  */
@@ -115,6 +167,15 @@ struct map
   struct map *map_list_next;
   struct map **map_list_prevp;
 
+  /* The read ahead state.  map_fault may update this without holding
+     MAPS_LOCK (see map_fault).  */
+  struct map_readahead readahead;
+
+  /* A freed map is added to a list of retired maps.  It is only
+     returned to the slab once no thread can still reference it via
+     the map index.  */
+  struct map *retired_next;
+
 
   map_destroy_t destroy;
 };
@@ -164,11 +225,36 @@ maps_lock_lock (void)
   ss_mutex_lock (&maps_lock);
 }
 
+/* map_fault looks up maps without taking MAPS_LOCK using the map
+   index, an immutable sorted array of the connected maps.  When a
+   holder of MAPS_LOCK changes MAPS or a connected map's region,
+   offset or access, the index becomes stale.  maps_lock_unlock then
+   retracts it using maps_index_retract.  Until the index is rebuilt,
+   map_fault takes MAPS_LOCK; the first call that does so rebuilds
+   it.  */
+extern bool maps_index_stale;
+
+/* Retract the map index and wait until no thread references it.  The
+   caller must hold MAPS_LOCK.  */
+extern void maps_index_retract (void);
+
+/* Indicate that the map index is stale.  This must be called by a
+   holder of MAPS_LOCK who changes a connected map's region, offset or
+   access without using the functions below.  */
+static inline void
+maps_index_invalidate (void)
+{
+  maps_index_stale = true;
+}
+
 static inline void
 maps_lock_unlock (void)
 {
   extern ss_mutex_t maps_lock;
 
+  if (maps_index_stale)
+    maps_index_retract ();
+
   ss_mutex_unlock (&maps_lock);
 }
 
@@ -25,6 +25,7 @@
 #include <hurd/startup.h>
 #include <hurd/capalloc.h>
 #include <hurd/mm.h>
+#include <hurd/thread.h>
 
 extern struct hurd_startup_data *__hurd_startup_data;      
 
@@ -245,9 +246,159 @@ hurd_message_buffer_alloc_hard (void)
   return mb;
 }
 
-static struct hurd_message_buffer *buffers;
+/* Free message buffers are cached at two levels.  Each thread has a
+   small magazine of free buffers in its UTCB, from which it allocates
+   and to which it frees without any atomic operations.  When a
+   thread's magazine is empty, it is refilled from a global depot;
+   when it is full, half of it is drained to the depot.
+
+   The depot is a lock-free stack.  A plain compare and swap on the
+   head is subject to the ABA problem: between reading the head and
+   its next pointer, another thread may pop the head, pop the next
+   buffer and push the head back.  To detect this, the head is paired
+   with a tag, which is incremented on each update, and both are
+   updated using a single double-word compare and swap.  Buffers are
+   never returned to the slab, so it is safe to dereference a buffer
+   that another thread has popped in the mean time.  */
+union depot
+{
+  struct
+  {
+    struct hurd_message_buffer *head;
+    uintptr_t tag;
+  };
+#if __WORDSIZE == 32
+  uint64_t raw;
+#elif __WORDSIZE == 64
+  unsigned __int128 raw;
+#else
+# error __WORDSIZE not defined or invalid.
+#endif
+};
+
+static union depot depot __attribute__ ((aligned (sizeof (union depot))));
+/* The number of buffers in the depot.  */
 static int buffers_count;
 
+/* The maximum number of buffers in a thread's magazine.  */
+#define MAGAZINE_SIZE 8
+
+static struct hurd_message_buffer_stats stats;
+
+/* Push the chain of COUNT buffers starting with FIRST and ending with
+   LAST onto the depot.  */
+static void
+depot_push (struct hurd_message_buffer *first,
+	    struct hurd_message_buffer *last, int count)
+{
+  union depot old, new;
+  do
+    {
+      old.raw = depot.raw;
+
+      last->next = old.head;
+      new.head = first;
+      new.tag = old.tag + 1;
+    }
+  while (__sync_val_compare_and_swap (&depot.raw, old.raw, new.raw)
+	 != old.raw);
+
+  __sync_fetch_and_add (&buffers_count, count);
+}
+
+/* Pop up to COUNT buffers from the depot.  Returns the chain of
+   buffers, which is terminated by NULL, and the number of buffers in
+   it in *POPPED.  */
+static struct hurd_message_buffer *
+depot_pop (int count, int *popped)
+{
+  union depot old, new;
+  int n;
+  do
+    {
+      old.raw = depot.raw;
+      if (! old.head)
+	{
+	  *popped = 0;
+	  return NULL;
+	}
+
+      /* If another thread changes the stack while we walk it, the
+	 tag changes and the compare and swap fails.  */
+      struct hurd_message_buffer *last = old.head;
+      for (n = 1; n < count && last->next; n ++)
+	last = last->next;
+
+      new.head = last->next;
+      new.tag = old.tag + 1;
+    }
+  while (__sync_val_compare_and_swap (&depot.raw, old.raw, new.raw)
+	 != old.raw);
+
+  __sync_fetch_and_add (&buffers_count, - n);
+
+  /* Terminate the chain.  */
+  struct hurd_message_buffer *last = old.head;
+  int i;
+  for (i = 1; i < n; i ++)
+    last = last->next;
+  last->next = NULL;
+
+  *popped = n;
+  return old.head;
+}
+
+/* Return the calling thread's UTCB if the calling thread may use its
+   magazine and mark the magazine as busy.  Otherwise, return NULL.
+
+   The magazine may not be used in activated mode: the activation may
+   have interrupted the thread while it was manipulating its magazine.
+   The same is true of a fault handler that is run in normal mode on
+   behalf of an activation, which is detected using the busy flag.  */
+static struct hurd_utcb *
+magazine_get (void)
+{
+  if (unlikely (! mm_init_done))
+    return NULL;
+
+  struct hurd_utcb *utcb = hurd_utcb ();
+  if (unlikely (utcb->vg.activated_mode || utcb->message_buffers_busy))
+    return NULL;
+
+  utcb->message_buffers_busy = true;
+  __asm__ __volatile__ ("" : : : "memory");
+
+  return utcb;
+}
+
+static void
+magazine_put (struct hurd_utcb *utcb)
+{
+  __asm__ __volatile__ ("" : : : "memory");
+  utcb->message_buffers_busy = false;
+}
+
+/* Drain the COUNT buffers at the head of UTCB's magazine to the
+   depot.  The caller must have exclusive access to the magazine.  */
+static void
+magazine_drain (struct hurd_utcb *utcb, int count)
+{
+  assert (count > 0 && count <= utcb->message_buffers_count);
+
+  struct hurd_message_buffer *first = utcb->message_buffers;
+  struct hurd_message_buffer *last = first;
+  int i;
+  for (i = 1; i < count; i ++)
+    last = last->next;
+
+  utcb->message_buffers = last->next;
+  utcb->message_buffers_count -= count;
+
+  depot_push (first, last, count);
+
+  __sync_fetch_and_add (&stats.drains, 1);
+}
+
 void
 hurd_message_buffer_free (struct hurd_message_buffer *buffer)
 {
@@ -255,17 +406,37 @@ hurd_message_buffer_free (struct hurd_message_buffer *buffer)
      water mark.  */
   // hurd_slab_dealloc (&message_buffer_slab, buffer);
 
-  /* Add BUFFER to the free list.  */
-  for (;;)
+  struct hurd_utcb *utcb = magazine_get ();
+  if (unlikely (! utcb))
     {
-      buffer->next = buffers;
-      if (__sync_val_compare_and_swap (&buffers, buffer->next, buffer)
-	  == buffer->next)
-	{
-	  __sync_fetch_and_add (&buffers_count, 1);
-	  return;
-	}
+      depot_push (buffer, buffer, 1);
+      return;
     }
+
+  if (unlikely (utcb->message_buffers_count == MAGAZINE_SIZE))
+    magazine_drain (utcb, MAGAZINE_SIZE / 2);
+
+  buffer->next = utcb->message_buffers;
+  utcb->message_buffers = buffer;
+  utcb->message_buffers_count ++;
+
+  magazine_put (utcb);
+}
+
+void
+hurd_message_buffer_cache_release (struct hurd_utcb *utcb)
+{
+  /* The thread is no longer running and thus can't be using its
+     magazine.  */
+  if (utcb->message_buffers_count > 0)
+    magazine_drain (utcb, utcb->message_buffers_count);
+}
+
+void
+hurd_message_buffer_stats (struct hurd_message_buffer_stats *s)
+{
+  *s = stats;
+  s->depot = buffers_count;
 }
 
 static int
@@ -282,42 +453,113 @@ num_threads (void)
 #define BUFFERS_LOW_WATER (4 + num_threads () * 2)
 #define BUFFERS_HIGH_WATER (8 + num_threads () * 3)
 
+/* Allocate a buffer from the depot, replenishing the depot if it is
+   running low.  If MAGAZINE is true, also move up to half a
+   magazine's worth of buffers to the chain returned in *EXTRA and
+   their number to *EXTRA_COUNT.  */
+static struct hurd_message_buffer *
+depot_alloc (bool magazine,
+	     struct hurd_message_buffer **extra, int *extra_count)
+{
+  static int allocating;
+
+  *extra_count = 0;
+
+  if (likely (mm_init_done)
+      && unlikely (buffers_count <= BUFFERS_LOW_WATER)
+      && ! allocating
+      && __sync_val_compare_and_swap (&allocating, 0, 1) == 0)
+    {
+      struct hurd_message_buffer *mb;
+      for (;;)
+	{
+	  mb = hurd_message_buffer_alloc_hard ();
+	  __sync_fetch_and_add (&stats.creates, 1);
+
+	  if (buffers_count >= BUFFERS_HIGH_WATER)
+	    break;
+
+	  depot_push (mb, mb, 1);
+	}
+
+      allocating = 0;
+      return mb;
+    }
+
+  int n;
+  struct hurd_message_buffer *mb
+    = depot_pop (magazine ? 1 + MAGAZINE_SIZE / 2 : 1, &n);
+  if (! mb)
+    {
+      __sync_fetch_and_add (&stats.creates, 1);
+      return hurd_message_buffer_alloc_hard ();
+    }
+
+  if (n > 1)
+    {
+      *extra = mb->next;
+      *extra_count = n - 1;
+    }
+
+  return mb;
+}
+
 struct hurd_message_buffer *
 hurd_message_buffer_alloc (void)
 {
   struct hurd_message_buffer *mb;
-  do
+
+  struct hurd_utcb *utcb = magazine_get ();
+  if (unlikely (! utcb))
     {
-      static int allocating;
+      struct hurd_message_buffer *extra;
+      int extra_count;
+      return depot_alloc (false, &extra, &extra_count);
+    }
 
-      if (likely (mm_init_done)
-	  && unlikely (buffers_count <= BUFFERS_LOW_WATER)
-	  && ! allocating
-	  && __sync_val_compare_and_swap (&allocating, 0, 1) == 0)
-	{
-	  for (;;)
-	    {
-	      mb = hurd_message_buffer_alloc_hard ();
+  mb = utcb->message_buffers;
+  if (likely (!! mb))
+    {
+      utcb->message_buffers = mb->next;
+      utcb->message_buffers_count --;
 
-	      if (buffers_count == BUFFERS_HIGH_WATER)
-		break;
+      magazine_put (utcb);
+      return mb;
+    }
 
-	      hurd_message_buffer_free (mb);
-	    }
+  /* The magazine is empty.  Refill it.  We may not hold the magazine
+     while replenishing the depot: that sends messages.  */
+  assert (utcb->message_buffers_count == 0);
+  magazine_put (utcb);
 
-	  allocating = 0;
-	  return mb;
-	}
+  struct hurd_message_buffer *extra;
+  int extra_count;
+  mb = depot_alloc (true, &extra, &extra_count);
 
-      mb = buffers;
-      if (! mb)
+  if (extra_count > 0)
+    {
+      __sync_fetch_and_add (&stats.refills, 1);
+
+      utcb = magazine_get ();
+      if (likely (utcb && ! utcb->message_buffers))
 	{
-	  mb = hurd_message_buffer_alloc_hard ();
-	  return mb;
+	  utcb->message_buffers = extra;
+	  utcb->message_buffers_count = extra_count;
+	  magazine_put (utcb);
+	}
+      else
+	/* The magazine is busy or was refilled in the mean time.
+	   Return the buffers to the depot.  */
+	{
+	  if (utcb)
+	    magazine_put (utcb);
+
+	  struct hurd_message_buffer *last = extra;
+	  while (last->next)
+	    last = last->next;
+	  depot_push (extra, last, extra_count);
 	}
     }
-  while (__sync_val_compare_and_swap (&buffers, mb, mb->next) != mb);
-  __sync_fetch_and_add (&buffers_count, -1);
 
   return mb;
 }
@@ -75,6 +75,30 @@ extern struct hurd_message_buffer *hurd_message_buffer_alloc_long (void);
 /* Free a message buffer.  */
 extern void hurd_message_buffer_free (struct hurd_message_buffer *buf);
 
+struct hurd_utcb;
+
+/* Return the message buffers cached by the thread with the user
+   thread control block UTCB to the global cache.  This must be called
+   before freeing a thread's UTCB.  */
+extern void hurd_message_buffer_cache_release (struct hurd_utcb *utcb);
+
+struct hurd_message_buffer_stats
+{
+  /* The number of times a thread's cache was refilled from the global
+     cache.  */
+  uintptr_t refills;
+  /* The number of times a thread's cache was drained to the global
+     cache.  */
+  uintptr_t drains;
+  /* The number of message buffers that have been created.  */
+  uintptr_t creates;
+  /* The number of message buffers currently in the global cache.  */
+  int depot;
+};
+
+/* Return statistics about the message buffer caches in *STATS.  */
+extern void hurd_message_buffer_stats (struct hurd_message_buffer_stats *stats);
+
 # endif /* _HURD_MESSAGE_BUFFER */
 
 #endif /* !__need_hurd_message_buffer */
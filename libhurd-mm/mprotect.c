@@ -123,6 +123,9 @@ mprotect (void *addr, size_t length, int prot)
 	     access: faulting will handle that.  */
 	  {
 	    map->access = access;
+	    /* Retract the index before revoking the access so that a
+	       concurrent fault does not reinstate it.  */
+	    maps_index_retract ();
 
 	    vg_addr_t addr;
 	    for (addr = VG_ADDR (map_start, VG_ADDR_BITS - PAGESIZE_LOG2);
@@ -157,7 +160,10 @@ mprotect (void *addr, size_t length, int prot)
 	      }
 	  }
 	else
-	  map->access = access;
+	  {
+	    map->access = access;
+	    maps_index_invalidate ();
+	  }
       }
 
   maps_lock_unlock ();
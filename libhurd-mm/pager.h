@@ -79,9 +79,14 @@ struct pager
   pager_no_refs_t no_refs;
 
   pager_advise_t advise;
+
+  /* If true, map_fault may ask FAULT to fault in multiple pages
+     around the faulting page (see map.h).  Otherwise, it always asks
+     for a single page.  */
+  bool readahead;
 };
 
-#define PAGER_VOID { NULL, 0, 0, NULL, NULL, NULL }
+#define PAGER_VOID { NULL, 0, 0, NULL, NULL, NULL, false }
 
 /* Initialize the pager.  All fields must be set appropriately.  After
    calling this function, LENGTH and FAULT may no longer be
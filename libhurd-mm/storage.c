@@ -28,6 +28,7 @@
 #include <hurd/startup.h>
 #include <viengoos/misc.h>
 #include <hurd/mutex.h>
+#include <hurd/thread.h>
 #include <backtrace.h>
 
 #ifndef NDEBUG
@@ -69,6 +70,12 @@ struct storage_desc
   /* The storage object's mode of allocation.  */
   char mode;
 
+  /* Whether a thread has reserved the storage area for its
+     allocations.  If so, it is on the RESERVED list and not freed
+     when empty.  Only changed when STORAGE_DESCS_LOCK is also
+     held.  */
+  bool reserved;
+
   /* Protects all members above here.  This lock may be taken if
      STORAGE_DESCS_LOCK is held.  */
   ss_mutex_t lock;
@@ -226,6 +233,14 @@ static struct storage_desc *long_lived_allocing;
 static struct storage_desc *long_lived_freeing;
 static struct storage_desc *short_lived;
 
+/* To avoid taking STORAGE_DESCS_LOCK on each allocation, a thread
+   reserves a long-lived storage area (see HURD_UTCB->
+   STORAGE_RESERVATION) and allocates from it until it is full.  The
+   reserved storage areas (full or not) live on this list.  When the
+   other lists are empty, threads allocate from other threads'
+   reserved storage areas before allocating a new folio.  */
+static struct storage_desc *reserved;
+
 /* The storage area is a source of allocations.  */
 #define LONG_LIVED_ALLOCING 1
 /* The storage area has been full.  */
@@ -488,6 +503,7 @@ storage_check_reserve_internal (bool force_allocate,
   s->folio = addr;
   memset (&s->alloced, 0, sizeof (s->alloced));
   s->free = VG_FOLIO_OBJECTS;
+  s->reserved = false;
 
   if (likely (as_init_done))
     {
@@ -538,19 +554,101 @@ storage_check_reserve (bool i_may_have_lock)
 				  i_may_have_lock);
 }
 
-#undef storage_alloc
-struct storage
-storage_alloc (vg_addr_t activity,
-	       enum vg_cap_type type, enum storage_expectancy expectancy,
-	       struct vg_object_policy policy,
-	       vg_addr_t addr)
+void
+storage_reservation_release (struct hurd_utcb *utcb)
+{
+  struct storage_desc *desc = utcb->storage_reservation;
+  if (! desc)
+    return;
+
+  utcb->storage_reservation = NULL;
+
+  ss_mutex_lock (&storage_descs_lock);
+  ss_mutex_lock (&desc->lock);
+  assert (desc->owner == vg_niltid);
+  desc->owner = hurd_myself ();
+
+  assert (desc->reserved);
+  list_unlink (desc);
+  desc->reserved = false;
+
+  if (desc->free)
+    list_link (&long_lived_allocing, desc);
+  else
+    /* The folio is full.  */
+    desc->mode = LONG_LIVED_STABLE;
+
+  assert (desc->owner == hurd_myself ());
+  desc->owner = vg_niltid;
+  ss_mutex_unlock (&desc->lock);
+  ss_mutex_unlock (&storage_descs_lock);
+}
+
+/* If the thread with the user thread control block UTCB has reserved
+   a storage area and it has a free object, lock it and return it.
+   Otherwise, return NULL.  */
+static struct storage_desc *
+reservation_lock (struct hurd_utcb *utcb)
+{
+  struct storage_desc *desc = utcb->storage_reservation;
+  if (! desc)
+    return NULL;
+
+  if (! ss_mutex_trylock (&desc->lock))
+    /* Another thread is freeing an object in or allocating from our
+       folio.  Rather than wait, take the slow path.  */
+    return NULL;
+
+  assert (desc->owner == vg_niltid);
+  desc->owner = hurd_myself ();
+
+  assert (desc->reserved);
+  if (likely (desc->free > 0))
+    return desc;
+
+  /* The folio is full.  Give it up.  */
+  desc->owner = vg_niltid;
+  ss_mutex_unlock (&desc->lock);
+
+  storage_reservation_release (utcb);
+
+  return NULL;
+}
+
+/* Allocate up to COUNT consecutive objects of type TYPE from a single
+   folio.  Store the shadow capability slot and the address of the Ith
+   object in STORAGE[I].  If ADDR is not VG_ADDR_VOID, install a
+   capability to the Ith object at vg_addr_add (ADDR, I).  Returns the
+   number of objects allocated, which is at least 1.  */
+static int
+storage_alloc_run (vg_addr_t activity,
+		   enum vg_cap_type type, enum storage_expectancy expectancy,
+		   struct vg_object_policy policy,
+		   vg_addr_t addr, int count, struct storage *storage)
 {
   assert (storage_init_done);
+  assert (count > 0);
+
+  /* Only long-lived storage is allocated from a thread's
+     reservation.  */
+  struct hurd_utcb *utcb = NULL;
+  if (likely (as_init_done) && expectancy != STORAGE_EPHEMERAL)
+    utcb = hurd_utcb ();
+
+  struct storage_desc *desc = NULL;
+  if (utcb)
+    {
+      storage_check_reserve_internal (false, meta_data_activity,
+				      expectancy, true);
+      desc = reservation_lock (utcb);
+    }
+
+  /* Whether we hold STORAGE_DESCS_LOCK.  */
+  bool descs_locked = false;
 
-  struct storage_desc *desc;
   bool do_allocate = false;
   int tries = 0;
-  do
+  while (! desc)
     {
       if (++ tries == 5)
 	{
@@ -589,6 +687,27 @@ storage_alloc (vg_addr_t activity,
 	return NULL;
       }
 
+      /* Find a storage area reserved by another thread that has a
+	 free object.  */
+      struct storage_desc *steal (void)
+      {
+	struct storage_desc *list;
+	for (list = reserved; list; list = list->next)
+	  if (list->free > 0 && ss_mutex_trylock (&list->lock))
+	    {
+	      assert (list->owner == vg_niltid);
+	      if (list->free > 0)
+		{
+		  list->owner = hurd_myself ();
+		  return list;
+		}
+
+	      ss_mutex_unlock (&list->lock);
+	    }
+
+	return NULL;
+      }
+
       ss_mutex_lock (&storage_descs_lock);
 
       if (expectancy == STORAGE_EPHEMERAL)
@@ -614,16 +733,36 @@ storage_alloc (vg_addr_t activity,
 		  list_link (&long_lived_allocing, desc);
 		}
 	    }
+
+	  if (desc && utcb && ! utcb->storage_reservation
+	      && desc->free > count)
+	    /* Reserve DESC for this thread's future allocations.  */
+	    {
+	      list_unlink (desc);
+	      desc->mode = LONG_LIVED_ALLOCING;
+	      desc->reserved = true;
+	      list_link (&reserved, desc);
+
+	      utcb->storage_reservation = desc;
+	    }
 	}
 
-      if (! desc || desc->free != 1)
-	/* Only drop this lock if we are not about to allocate the last
-	   page.  Otherwise, we still need the lock.  */
+      if (! desc)
+	/* All free objects are in storage areas reserved by other
+	   threads.  Rather than allocate a new folio, use one of
+	   them.  */
+	desc = steal ();
+
+      if (desc && ! desc->reserved && desc->free <= count)
+	/* We may be about to allocate the last object.  If so, we
+	   need to remove the folio from its list and thus still need
+	   this lock.  */
+	descs_locked = true;
+      else
 	ss_mutex_unlock (&storage_descs_lock);
 
       do_allocate = true;
     }
-  while (! desc);
 
   /* DESC desigantes a storage area from which we can allocate a page.
      DESC->LOCK is held.  */
@@ -633,23 +772,31 @@ storage_alloc (vg_addr_t activity,
 	   "Folio (" VG_ADDR_FMT ") full (free: %d) but on a list!",
 	   VG_ADDR_PRINTF (desc->folio), desc->free);
 
+  /* Extend the run as far as the following objects are free.  */
+  int n = 1;
+  while (n < count && idx + n < VG_FOLIO_OBJECTS
+	 && ! bit_test (desc->alloced, idx + n))
+    {
+      bit_set (desc->alloced, sizeof (desc->alloced), idx + n);
+      n ++;
+    }
+
   vg_addr_t folio = desc->folio;
-  vg_addr_t object = vg_addr_extend (folio, idx, VG_FOLIO_OBJECTS_LOG2);
 
-  debug (5, "Allocating object %d as %s from " VG_ADDR_FMT " (" VG_ADDR_FMT ") "
+  debug (5, "Allocating objects %d-%d as %s from " VG_ADDR_FMT " "
 	 "(%d left), installing at " VG_ADDR_FMT,
-	 idx, vg_cap_type_string (type),
-	 VG_ADDR_PRINTF (folio), VG_ADDR_PRINTF (object),
-	 desc->free, VG_ADDR_PRINTF (addr));
+	 idx, idx + n - 1, vg_cap_type_string (type),
+	 VG_ADDR_PRINTF (folio), desc->free, VG_ADDR_PRINTF (addr));
 
-  atomic_decrement (&free_count);
-  desc->free --;
+  atomic_add (&free_count, - n);
+  desc->free -= n;
 
-  if (desc->free == 0)
+  if (desc->free == 0 && ! desc->reserved)
     /* The folio is now full.  We can't take the STORAGE_DESCS_LOCK
        lock as we have DESC->LOCK.  Finish what we are doing and only
        then actually remove it.  */
     {
+      assert (descs_locked);
       assert (bit_alloc (desc->alloced, sizeof (desc->alloced), 0) == -1);
 
       debug (3, "Folio at " VG_ADDR_FMT " full", VG_ADDR_PRINTF (folio));
@@ -663,72 +810,111 @@ storage_alloc (vg_addr_t activity,
 
       ss_mutex_unlock (&storage_descs_lock);
     }
+  else if (descs_locked)
+    ss_mutex_unlock (&storage_descs_lock);
 
   struct vg_object *shadow = desc->shadow;
-  struct vg_cap *cap = NULL;
-  if (likely (!! shadow))
+  int i;
+  for (i = 0; i < n; i ++)
     {
-      cap = &shadow->caps[idx];
-      VG_CAP_PROPERTIES_SET (cap, VG_CAP_PROPERTIES (policy,
-						     VG_CAP_ADDR_TRANS_VOID));
-      cap->type = type;
+      struct vg_cap *cap = NULL;
+      if (likely (!! shadow))
+	{
+	  cap = &shadow->caps[idx + i];
+	  VG_CAP_PROPERTIES_SET (cap, VG_CAP_PROPERTIES (policy,
+							 VG_CAP_ADDR_TRANS_VOID));
+	  cap->type = type;
+	}
+      else
+	assert (! as_init_done);
+
+      storage[i].cap = cap;
+      storage[i].addr = vg_addr_extend (folio, idx + i,
+					VG_FOLIO_OBJECTS_LOG2);
     }
-  else
-    assert (! as_init_done);
 
   /* We drop DESC->LOCK.  */
   assert (desc->owner == hurd_myself ());
   desc->owner = vg_niltid;
   ss_mutex_unlock (&desc->lock);
 
-  vg_addr_t a = addr;
-  error_t err = vg_folio_object_alloc (activity, folio, idx, type, policy, 0,
-				       &a, NULL);
+  error_t err;
+  if (n == 1)
+    {
+      vg_addr_t a = addr;
+      err = vg_folio_object_alloc (activity, folio, idx, type, policy, 0,
+				   &a, NULL);
+      assert (err || VG_ADDR_EQ (a, addr));
+    }
+  else
+    err = vg_folio_object_alloc_range (activity, folio, idx, n, type, policy,
+				       addr);
   assertx (! err,
-	   "Allocating object %d from " VG_ADDR_FMT " at " VG_ADDR_FMT ": %d!",
-	   idx, VG_ADDR_PRINTF (folio), VG_ADDR_PRINTF (addr), err);
-  assert (VG_ADDR_EQ (a, addr));
+	   "Allocating objects %d-%d from " VG_ADDR_FMT " at " VG_ADDR_FMT
+	   ": %d!",
+	   idx, idx + n - 1, VG_ADDR_PRINTF (folio), VG_ADDR_PRINTF (addr),
+	   err);
 
   if (! VG_ADDR_IS_VOID (addr))
     /* We also have to update the shadow for VG_ADDR.  Unfortunately, we
        don't have the cap although the caller might.  */
-    {
-      bool ret = as_slot_lookup_use
-	(addr,
-	 ({
-	   slot->type = type;
-	   vg_cap_set_shadow (slot, NULL);
-	   VG_CAP_POLICY_SET (slot, policy);
-	 }));
-      if (! ret)
-	{
-	  as_dump (NULL);
-	  assert (ret);
-	}
-    }
-
-  struct storage storage;
-  storage.cap = cap;
-  storage.addr = object;
+    for (i = 0; i < n; i ++)
+      {
+	bool ret = as_slot_lookup_use
+	  (vg_addr_add (addr, i),
+	   ({
+	     slot->type = type;
+	     vg_cap_set_shadow (slot, NULL);
+	     VG_CAP_POLICY_SET (slot, policy);
+	   }));
+	if (! ret)
+	  {
+	    as_dump (NULL);
+	    assert (ret);
+	  }
+      }
 
 #ifndef NDEBUG
   if (type == vg_cap_page)
-    {
-      unsigned int *p = VG_ADDR_TO_PTR (vg_addr_extend (storage.addr,
-						  0, PAGESIZE_LOG2));
-      int c;
-      for (c = 0; c < PAGESIZE / sizeof (int); c ++)
-	assertx (p[c] == 0,
-		 VG_ADDR_FMT "(%p)[%d] = %x",
-		 VG_ADDR_PRINTF (storage.addr), p, c * sizeof (int), p[c]);
-    }
+    for (i = 0; i < n; i ++)
+      {
+	unsigned int *p = VG_ADDR_TO_PTR (vg_addr_extend (storage[i].addr,
+							  0, PAGESIZE_LOG2));
+	int c;
+	for (c = 0; c < PAGESIZE / sizeof (int); c ++)
+	  assertx (p[c] == 0,
+		   VG_ADDR_FMT "(%p)[%d] = %x",
+		   VG_ADDR_PRINTF (storage[i].addr), p, c * sizeof (int), p[c]);
+      }
 #endif
-  debug (5, "Allocated " VG_ADDR_FMT "; " VG_ADDR_FMT,
-	 VG_ADDR_PRINTF (storage.addr), VG_ADDR_PRINTF (addr));
+  debug (5, "Allocated %d objects at " VG_ADDR_FMT "; " VG_ADDR_FMT,
+	 n, VG_ADDR_PRINTF (storage[0].addr), VG_ADDR_PRINTF (addr));
 
+  return n;
+}
+
+#undef storage_alloc
+struct storage
+storage_alloc (vg_addr_t activity,
+	       enum vg_cap_type type, enum storage_expectancy expectancy,
+	       struct vg_object_policy policy,
+	       vg_addr_t addr)
+{
+  struct storage storage;
+  storage_alloc_run (activity, type, expectancy, policy, addr, 1, &storage);
   return storage;
 }
 
+int
+storage_alloc_n (vg_addr_t activity,
+		 enum vg_cap_type type, enum storage_expectancy expectancy,
+		 struct vg_object_policy policy,
+		 vg_addr_t addr, int count, struct storage *storage)
+{
+  return storage_alloc_run (activity, type, expectancy, policy, addr,
+			    count, storage);
+}
+
 void
 storage_free_ (vg_addr_t object, bool unmap_now)
 {
@@ -755,13 +941,15 @@ storage_free_ (vg_addr_t object, bool unmap_now)
 
   struct vg_object *shadow = storage->shadow;
 
-  if (storage->free == VG_FOLIO_OBJECTS
-      || ((storage->free == VG_FOLIO_OBJECTS - 1)
-	  && shadow
-	  && VG_ADDR_EQ (folio,
-			 vg_addr_chop (VG_PTR_TO_ADDR (shadow),
-				       VG_FOLIO_OBJECTS_LOG2 + PAGESIZE_LOG2))))
-    /* The folio is now empty.  */
+  if (! storage->reserved
+      && (storage->free == VG_FOLIO_OBJECTS
+	  || ((storage->free == VG_FOLIO_OBJECTS - 1)
+	      && shadow
+	      && VG_ADDR_EQ (folio,
+			     vg_addr_chop (VG_PTR_TO_ADDR (shadow),
+					   VG_FOLIO_OBJECTS_LOG2
+					   + PAGESIZE_LOG2)))))
+    /* The folio is now empty (and not reserved by a thread).  */
     {
       debug (1, "Folio at " VG_ADDR_FMT " now empty", VG_ADDR_PRINTF (folio));
 
@@ -807,10 +995,10 @@ storage_free_ (vg_addr_t object, bool unmap_now)
 	}
     }
 
-  if (storage->free == 1)
+  if (storage->free == 1 && ! storage->reserved)
     {
       /* The folio is no longer completely full.  Return it to a
-	 list.  */
+	 list.  (A reserved folio stays on the RESERVED list.)  */
       if (storage->mode == STORAGE_EPHEMERAL)
 	list_link (&short_lived, storage);
       else
@@ -910,6 +1098,7 @@ storage_init (void)
 	  sdesc->folio = folio;
 	  sdesc->free = VG_FOLIO_OBJECTS;
 	  sdesc->mode = LONG_LIVED_ALLOCING;
+	  sdesc->reserved = false;
 
 	  list_link (&long_lived_allocing, sdesc);
 
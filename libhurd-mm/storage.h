@@ -80,6 +80,21 @@ extern struct storage storage_alloc (vg_addr_t activity,
   })
 
 
+/* Allocate up to COUNT objects of type TYPE, which must be at least 1,
+   as storage_alloc would.  The objects are consecutive objects of a
+   single folio and are allocated using a single kernel invocation.
+   If ADDR is not VG_ADDR_VOID, a capability to the Ith object is
+   saved at vg_addr_add (ADDR, I).  The shadow capability slot and the
+   address of the Ith object are returned in STORAGE[I].  Returns the
+   number of objects actually allocated, which may be less than COUNT
+   if the folio does not have COUNT consecutive free objects.  */
+extern int storage_alloc_n (vg_addr_t activity,
+			    enum vg_cap_type type,
+			    enum storage_expectancy expectancy,
+			    struct vg_object_policy policy,
+			    vg_addr_t addr, int count,
+			    struct storage *storage);
+
 /* Frees the storage at STORAGE.  STORAGE must be the address returned
    by storage_alloc (NOT the address provided to storage_alloc).  If
    UNMAP_NOW is not true, revoking the storage may be delayed.  */
@@ -90,6 +105,14 @@ extern void storage_free_ (vg_addr_t storage, bool unmap_now);
     storage_free_ (__sf_storage, __sf_unmap_now);			\
   })
 
+struct hurd_utcb;
+
+/* Release the folio that the thread with the user thread control
+   block UTCB has reserved for its allocations, if any.  A thread
+   normally releases its reservation when the folio becomes full.
+   This must also be called before freeing a thread's UTCB.  */
+extern void storage_reservation_release (struct hurd_utcb *utcb);
+
 /* Initialize the storage sub-system.  */
 extern void storage_init (void);
 
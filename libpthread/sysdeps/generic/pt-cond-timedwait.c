@@ -80,18 +80,23 @@ __pthread_cond_timedwait_internal (pthread_cond_t *cond,
       err = __pthread_timedblock (self, abstime);
       if (err)
 	/* We timed out.  We may need to disconnect ourself from the
-	   waiter queue.
-
-	   FIXME: What do we do if we get a wakeup message before we
-	   disconnect ourself?  It may remain until the next time we
-	   block.  */
+	   waiter queue.  If we are no longer on it, we were signalled
+	   before we could do so and the signaller is about to wake us:
+	   consume the wakeup and report success.  */
 	{
 	  assert (err == ETIMEDOUT);
 
-	  __pthread_spin_lock (&mutex->__lock);
-	  if (self->prevp)
+	  __pthread_spin_lock (&cond->__lock);
+	  int queued = !! self->prevp;
+	  if (queued)
 	    __pthread_dequeue (self);
-	  __pthread_spin_unlock (&mutex->__lock);
+	  __pthread_spin_unlock (&cond->__lock);
+
+	  if (! queued)
+	    {
+	      __pthread_block (self);
+	      err = 0;
+	    }
 	}
     }
   else
@@ -24,12 +24,46 @@
 
 #include <pt-internal.h>
 
+#include <hurd/stddef.h>
+#include <viengoos/futex.h>
+
 /* Block THREAD.  */
 error_t
 __pthread_timedblock (struct __pthread *thread,
 		      const struct timespec *abstime)
 {
-#warning Need gettimeofday to implement properly.
-  __pthread_block (thread);
+  assert (thread->lock_message_buffer);
+
+  /* The kernel takes a relative timeout.  */
+  struct timeval now;
+  gettimeofday (&now, NULL);
+
+  struct timespec timeout;
+  timeout.tv_sec = abstime->tv_sec - now.tv_sec;
+  timeout.tv_nsec = abstime->tv_nsec - now.tv_usec * 1000;
+  if (timeout.tv_nsec < 0)
+    {
+      timeout.tv_sec --;
+      timeout.tv_nsec += 1000000000;
+    }
+  if (timeout.tv_sec < 0)
+    return ETIMEDOUT;
+
+  struct hurd_message_buffer *mb = thread->lock_message_buffer;
+#ifndef NDEBUG
+  /* Try to detect recursive locks, which we don't handle.  */
+  thread->lock_message_buffer = NULL;
+#endif
+
+  struct vg_futex_return ret;
+  ret = futex_using (mb, &thread->threadid, FUTEX_WAIT, thread->threadid,
+		     &timeout, 0, 0);
+
+#ifndef NDEBUG
+  thread->lock_message_buffer = mb;
+#endif
+
+  if (ret.err == ETIMEDOUT)
+    return ETIMEDOUT;
   return 0;
 }
@@ -27,6 +27,7 @@ enum
   {
     VG_activity_policy = 700,
     VG_activity_info,
+    VG_activity_stats_page,
   };
 
 struct vg_activity_memory_policy
@@ -156,6 +157,9 @@ struct vg_activity_stats
      freed.  (If evicted is significant and saved approximates
      evicted, then the process is trashing.)  */
   uint32_t saved;
+
+  /* Number of page faults taken by threads using this activity.  */
+  uint32_t faults;
 };
 
 #define VG_ACTIVITY_POLICY(__ap_sibling_rel, __ap_child_rel, __ap_storage) \
@@ -247,6 +251,64 @@ RPC (activity_info, 2, 1, 0,
      /* Out: */
      struct vg_activity_info, info)
 
+/* The layout of an activity's statistics page (see
+   vg_activity_stats_page).  The kernel updates the page at the end
+   of each period without consulting the user.  SEQ is odd while an
+   update is in progress and is incremented again once it is complete.
+   Use vg_activity_stats_page_read to obtain a consistent copy.  */
+struct vg_activity_stats_page
+{
+  uint32_t seq;
+  /* The number of valid samples.  */
+  uint32_t count;
+  /* Samples are ordered by recency with the youngest towards the
+     start of the buffer.  */
+  struct vg_activity_stats stats[VG_ACTIVITY_STATS_PERIODS];
+};
+
+/* Have the kernel publish ACTIVITY's statistics in the page at
+   address PAGE in the calling thread's address space.  The page is
+   updated at the end of each period until it is replaced or
+   reclaimed.  If PAGE is VG_ADDR_VOID, stop publishing.  */
+RPC (activity_stats_page, 1, 0, 0,
+     /* cap_t principal, cap_t activity, */
+     vg_addr_t, page)
+
+#ifndef RM_INTERN
+/* Copy the samples in the statistics page PAGE to STATS, which must
+   have room for VG_ACTIVITY_STATS_PERIODS samples.  Returns the
+   number of valid samples.  This does not block the kernel: if the
+   kernel updates the page while it is being read, the copy is
+   retried.  */
+static inline int
+vg_activity_stats_page_read (struct vg_activity_stats_page *page,
+			     struct vg_activity_stats *stats)
+{
+  volatile struct vg_activity_stats_page *p = page;
+  uint32_t seq;
+  int count;
+
+  do
+    {
+      seq = p->seq;
+      __sync_synchronize ();
+
+      count = p->count;
+      if (count > VG_ACTIVITY_STATS_PERIODS)
+	count = VG_ACTIVITY_STATS_PERIODS;
+
+      int i;
+      for (i = 0; i < count; i ++)
+	stats[i] = p->stats[i];
+
+      __sync_synchronize ();
+    }
+  while ((seq & 1) || seq != p->seq);
+
+  return count;
+}
+#endif
+
 #undef RPC_STUB_PREFIX
 #undef RPC_ID_PREFIX
 #undef RPC_TARGET
@@ -381,7 +381,8 @@ enum
     VG_folio_alloc = 200,
     VG_folio_free,
     VG_folio_object_alloc,
-    VG_folio_policy
+    VG_folio_policy,
+    VG_folio_object_alloc_range
   };
 
 /* Allocate a folio against ACTIVITY.  Return a capability in the
@@ -436,6 +437,20 @@ RPC(folio_policy, 2, 1, 0,
     /* Out: */
     struct vg_folio_policy, old)
 
+/* Allocate COUNT objects of type TYPE in folio FOLIO starting with
+   the INDEXth object.  This is equivalent to invoking
+   folio_object_alloc on each of the objects with a return code of 0.
+   If ADDR is not VG_ADDR_VOID, a capability to the Ith object is
+   stored in the slot at address vg_addr_add (ADDR, I) in the caller's
+   address space; the slots' address translators and policies are
+   preserved.  The slots are checked before any object is allocated:
+   if one does not exist or is not writable, no object is allocated.
+   If one lies in an object being allocated, EINVAL is returned.  */
+RPC(folio_object_alloc_range, 5, 0, 0,
+    /* cap_t, principal, cap_t, folio, */
+    uintptr_t, index, uintptr_t, count, uintptr_t, type,
+    struct vg_object_policy, policy, vg_addr_t, addr)
+
 #undef RPC_STUB_PREFIX
 #undef RPC_ID_PREFIX
 
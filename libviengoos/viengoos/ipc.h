@@ -80,6 +80,9 @@ enum
 
   };
 
+/* The L4 label of a fast query (see vg_ipc_fast).  */
+#define VG_IPC_FAST_LABEL 8195
+
 #ifndef RM_INTERN
 /* An IPC consists of three phases: the receive phase, the send phase
    and the return phase.  All three phases are optional.  Each phase
@@ -282,6 +285,74 @@ vg_reply (uintptr_t flags, vg_addr_t send_activity, vg_addr_t target_messenger,
 		      0, 0, VG_ADDR_VOID);
 }
 
+/* Invoke the read-only method METHOD on the object at address TARGET
+   in the caller's address space (if VG_ADDR_VOID, the calling
+   thread).  ARG is the method's argument, if any.  On success, the
+   method's result is returned in *RESULT.
+
+   Unlike a normal method invocation, the request and the reply are
+   passed in message registers: no messenger or message buffer is
+   used.  Only methods with at most one word of input and of output
+   are supported: VG_thread_id and VG_object_status (ARG is CLEAR).
+   For other methods, ENOSYS is returned.  */
+static inline error_t
+vg_ipc_fast (uintptr_t method, vg_addr_t target, uintptr_t arg,
+	     uintptr_t *result)
+{
+  error_t err = 0;
+
+#ifdef USE_L4
+  l4_msg_tag_t tag = l4_niltag;
+  l4_msg_tag_set_label (&tag, VG_IPC_FAST_LABEL);
+
+  l4_msg_t msg;
+  l4_msg_clear (msg);
+  l4_msg_set_msg_tag (msg, tag);
+
+  l4_msg_append_word (msg, method);
+  int i;
+  for (i = 0; i < sizeof (vg_addr_t) / sizeof (uintptr_t); i ++)
+    l4_msg_append_word (msg, ((uintptr_t *) &target)[i]);
+  l4_msg_append_word (msg, arg);
+
+  extern struct hurd_startup_data *__hurd_startup_data;
+
+  bool call = true;
+  while (1)
+    {
+      if (call)
+	{
+	  l4_msg_load (msg);
+	  tag = l4_call (__hurd_startup_data->rm);
+	}
+      else
+	tag = l4_receive (__hurd_startup_data->rm);
+
+      if (likely (! l4_ipc_failed (tag)))
+	break;
+
+      if (((l4_error_code () >> 1) & 0x7) != 3)
+	return EHOSTDOWN;
+
+      if ((l4_error_code () & 1))
+	/* Interrupted in the receive phase: the reply was lost.
+	   Resend the request.  */
+	call = true;
+      else
+	call = false;
+    }
+
+  l4_msg_store (tag, msg);
+  err = l4_msg_word (msg, 0);
+  if (! err && result)
+    *result = l4_msg_word (msg, 1);
+#else
+# warning vg_ipc_fast not ported to this architecture.
+#endif
+
+  return err;
+}
+
 /* Suspend the caller until the next activation.  */
 static inline error_t
 vg_suspend (void)
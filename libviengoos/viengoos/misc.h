@@ -26,6 +26,7 @@
 #include <viengoos/thread.h>
 #include <viengoos/activity.h>
 #include <viengoos/futex.h>
+#include <viengoos/ring.h>
 #include <l4/message.h>
 
 enum rm_method_id
@@ -36,57 +37,60 @@ enum rm_method_id
     VG_fault,
   };
 
+/* All methods implemented by the kernel.  For each method NAME, the
+   list invokes M (NAME).  This is used to generate tables indexed by
+   method (see VG_METHOD_INDEX).  */
+#define VG_METHODS(M)				\
+  M (write)					\
+  M (read)					\
+  M (as_dump)					\
+  M (fault)					\
+  M (folio_alloc)				\
+  M (folio_free)				\
+  M (folio_object_alloc)			\
+  M (folio_policy)				\
+  M (folio_object_alloc_range)		\
+  M (cap_copy)					\
+  M (cap_rubout)				\
+  M (cap_read)					\
+  M (object_discarded_clear)			\
+  M (object_discard)				\
+  M (object_status)				\
+  M (object_reply_on_destruction)		\
+  M (object_name)				\
+  M (thread_exregs)				\
+  M (thread_id)					\
+  M (thread_activation_collect)			\
+  M (activity_policy)				\
+  M (activity_info)				\
+  M (activity_stats_page)			\
+  M (futex)					\
+  M (messenger_id)				\
+  M (ring_submit)
+
+/* All method ids are less than VG_METHOD_ID_LIMIT.  */
+#define VG_METHOD_ID_LIMIT 1024
+
+/* Dense method indexes: VG_METHOD_INDEX (NAME) is the index of the
+   method NAME.  Index 0 does not correspond to a method.  */
+#define VG_METHOD_INDEX(name_) VG_METHOD_INDEX_##name_
+#define VG_METHOD_INDEX_ENUM_(name_) VG_METHOD_INDEX (name_),
+enum
+  {
+    VG_METHOD_INDEX_none = 0,
+    VG_METHODS (VG_METHOD_INDEX_ENUM_)
+    VG_METHOD_COUNT
+  };
+#undef VG_METHOD_INDEX_ENUM_
+
 static inline const char *
 vg_method_id_string (int id)
 {
   switch (id)
     {
-    case VG_write:
-      return "write";
-    case VG_read:
-      return "read";
-    case VG_as_dump:
-      return "as_dump";
-    case VG_fault:
-      return "fault";
-    case VG_folio_alloc:
-      return "folio_alloc";
-    case VG_folio_free:
-      return "folio_free";
-    case VG_folio_object_alloc:
-      return "folio_object_alloc";
-    case VG_folio_policy:
-      return "folio_policy";
-    case VG_cap_copy:
-      return "cap_copy";
-    case VG_cap_rubout:
-      return "cap_rubout";
-    case VG_cap_read:
-      return "cap_read";
-    case VG_object_discarded_clear:
-      return "object_discarded_clear";
-    case VG_object_discard:
-      return "object_discard";
-    case VG_object_status:
-      return "object_status";
-    case VG_object_reply_on_destruction:
-      return "object_reply_on_destruction";
-    case VG_object_name:
-      return "object_name";
-    case VG_thread_exregs:
-      return "thread_exregs";
-    case VG_thread_id:
-      return "thread_id";
-    case VG_thread_activation_collect:
-      return "thread_activation_collect";
-    case VG_activity_policy:
-      return "activity_policy";
-    case VG_activity_info:
-      return "activity_info";
-    case VG_futex:
-      return "futex";
-    case VG_messenger_id:
-      return "messenger id";
+#define VG_METHOD_ID_STRING_(name_) case VG_##name_: return #name_;
+      VG_METHODS (VG_METHOD_ID_STRING_)
+#undef VG_METHOD_ID_STRING_
     default:
       return "unknown method id";
     }
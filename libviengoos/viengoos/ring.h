@@ -0,0 +1,118 @@
+/* ring.h - Submission ring interface.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef _VIENGOOS_RING_H
+#define _VIENGOOS_RING_H 1
+
+#include <stdint.h>
+#include <viengoos/addr.h>
+
+/* A submission ring allows a thread to invoke a number of kernel
+   objects using a single IPC.  The ring is a page shared between the
+   thread and the kernel.  The thread fills in entries, each naming an
+   object to invoke and a message buffer holding the request, and
+   advances HEAD.  It then invokes vg_ring_submit.  The kernel
+   executes the entries from TAIL up to HEAD in order, advancing TAIL
+   as it goes.
+
+   When an entry completes, the reply is written to the entry's
+   message buffer, overwriting the request.  The reply can be
+   unmarshalled using the method's reply_unmarshal function.  Any
+   capabilities that the method returns are stored in the slots named
+   by the entry's REPLY_CAPS.  The reply messenger in the request is
+   ignored.
+
+   Only methods that reply immediately may be submitted using a ring.
+   Other methods, e.g., VG_futex and VG_object_reply_on_destruction,
+   complete with EINVAL.  */
+
+/* The number of entries in a ring.  This must be a power of 2.  */
+#define VG_RING_ENTRIES 64
+
+/* The maximum number of capabilities that a method invoked via a ring
+   may return.  */
+#define VG_RING_REPLY_CAPS 2
+
+struct vg_ring_entry
+{
+  /* The object to invoke.  If VG_ADDR_VOID, the calling thread.  */
+  vg_addr_t target;
+  /* The page containing the request.  On completion, it contains the
+     reply.  */
+  vg_addr_t buffer;
+  /* The slots in which to store returned capabilities.  */
+  vg_addr_t reply_caps[VG_RING_REPLY_CAPS];
+  /* Set by the kernel when the entry completes: the error code.  */
+  uintptr_t status;
+};
+
+struct vg_ring
+{
+  /* The index of the next entry to fill.  Written by the thread.  */
+  uint32_t head;
+  /* The index of the next entry to execute.  Written by the
+     kernel.  */
+  uint32_t tail;
+
+  struct vg_ring_entry entries[VG_RING_ENTRIES];
+};
+
+#ifndef RM_INTERN
+/* Return the next free entry in RING and make it available to the
+   kernel.  Returns NULL if the ring is full.  */
+static inline struct vg_ring_entry *
+vg_ring_entry_alloc (struct vg_ring *ring)
+{
+  if (ring->head - ring->tail == VG_RING_ENTRIES)
+    return NULL;
+
+  struct vg_ring_entry *entry = &ring->entries[ring->head % VG_RING_ENTRIES];
+  entry->target = VG_ADDR_VOID;
+  entry->buffer = VG_ADDR_VOID;
+  int i;
+  for (i = 0; i < VG_RING_REPLY_CAPS; i ++)
+    entry->reply_caps[i] = VG_ADDR_VOID;
+
+  ring->head ++;
+
+  return entry;
+}
+#endif
+
+enum
+  {
+    VG_ring_submit = 1000,
+  };
+
+#define RPC_STUB_PREFIX vg
+#define RPC_ID_PREFIX VG
+
+#include <viengoos/rpc.h>
+
+/* Execute the entries in the submission ring in the page at address
+   RING.  At most VG_RING_ENTRIES entries are executed.  Returns the
+   number of entries executed in COUNT.  */
+RPC(ring_submit, 1, 1, 0,
+    /* cap_t activity, cap_t thread, */
+    vg_addr_t, ring, int, count)
+
+#undef RPC_STUB_PREFIX
+#undef RPC_ID_PREFIX
+
+#endif /* _VIENGOOS_RING_H  */
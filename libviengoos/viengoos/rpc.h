@@ -52,6 +52,11 @@
 #ifdef RM_INTERN
 extern struct vg_message *reply_buffer;
 
+/* The capabilities in a reply formulated by the kernel are pointers to
+   capabilities, which are only valid while the reply function runs.
+   Copy them to storage that remains valid until the next reply.  */
+extern void reply_buffer_pin (void);
+
 /* We can't include messenger.h as it includes hurd/cap.h which in turn
    includes this file.  */
 struct messenger;
@@ -863,7 +868,9 @@ typedef vg_addr_t cap_t;
 #endif
 
 /* Send a reply to __RPC_TARGET.  If __RPC_TARGET does not accept the
-   message immediately, abort sending.  */
+   message immediately, abort sending.  In the kernel, if
+   __RPC_TARGET is NULL, the reply is only marshalled into
+   REPLY_BUFFER.  */
 #ifndef RM_INTERN
 #define RPC_REPLY_(id, in_count, out_count, ret_cap_count, ...)		\
   static inline error_t							\
@@ -929,6 +936,13 @@ typedef vg_addr_t cap_t;
 		      RPC_CHOP2 (CPP_ADD (in_count, out_count),		\
 				 ##__VA_ARGS__)));			\
 									\
+    if (! __rpc_target)							\
+      /* The caller collects the reply from REPLY_BUFFER.  */		\
+      {									\
+	reply_buffer_pin ();						\
+	return 0;							\
+      }									\
+									\
     bool ret = messenger_message_load (__rpc_activity,			\
 				       __rpc_target, reply_buffer);	\
 									\
@@ -1024,7 +1038,9 @@ rpc_error_reply_marshal (struct vg_message *msg, error_t err)
   vg_message_append_word (msg, err);
 }
 
-/* Reply to the target TARGET with error code ERROR.  */
+/* Reply to the target TARGET with error code ERROR.  In the kernel,
+   if TARGET is NULL, the reply is only marshalled into
+   REPLY_BUFFER.  */
 #ifdef RM_INTERN
 static inline error_t
 __attribute__((always_inline))
@@ -1032,6 +1048,9 @@ rpc_error_reply (struct activity *activity, struct messenger *target,
 		 error_t err)
 {
   rpc_error_reply_marshal (reply_buffer, err);
+  if (! target)
+    return 0;
+
   bool ret = messenger_message_load (activity, target, reply_buffer);
   return ret ? 0 : EWOULDBLOCK;
 }
@@ -26,6 +26,7 @@
 #include "thread.h"
 #include "object.h"
 #include "profile.h"
+#include "server.h"
 #include "zalloc.h"
 #include "memory.h"
 
@@ -82,6 +83,7 @@ activity_destroy (struct activity *activity, struct activity *victim)
   assert (object_type ((struct vg_object *) victim) == vg_cap_activity_control);
 
   profile_stats_dump ();
+  server_method_stats_dump ();
 
   /* We should never destroy the root activity.  */
   if (! victim->parent)
@@ -430,6 +432,38 @@ activity_policy_update (struct activity *activity,
   activity->policy = policy;
 }
 
+void
+activity_stats_publish (struct activity *activity)
+{
+  /* Don't page the statistics page in just to update it.  */
+  struct vg_object *object = cap_to_object_soft (activity,
+						 &activity->stats_page);
+  if (! object)
+    return;
+  assert (object_type (object) == vg_cap_page);
+
+  volatile struct vg_activity_stats_page *page
+    = (struct vg_activity_stats_page *) object;
+
+  /* Readers retry if SEQ is odd or changes while they are reading.  */
+  page->seq ++;
+  __sync_synchronize ();
+
+  int i;
+  for (i = 0; i < VG_ACTIVITY_STATS_PERIODS; i ++)
+    {
+      int period = activity->current_period - 1 - i;
+      if (period < 0)
+	period = (VG_ACTIVITY_STATS_PERIODS + 1) + period;
+
+      page->stats[i] = activity->stats[period];
+    }
+  page->count = VG_ACTIVITY_STATS_PERIODS;
+
+  __sync_synchronize ();
+  page->seq ++;
+}
+
 static void
 do_activity_dump (struct activity *activity, int indent)
 {
@@ -58,6 +58,10 @@ struct activity
      children).  */
   uint32_t folio_count;
 
+  /* The page in which to publish this activity's statistics (see
+     vg_activity_stats_page).  */
+  struct vg_cap stats_page;
+
   /* Location of the in-memory parent activity.  An activity may only
      be in memory if its parent is in memory.  It is only NULL for the
      root activity.  This pointer is setup by activity_prepare.  */
@@ -190,6 +194,10 @@ extern void activity_policy_update (struct activity *activity,
 				    struct vg_activity_policy policy);
 
 
+/* Copy ACTIVITY's most recent statistics to its statistics page, if
+   it has one and it is in memory.  */
+extern void activity_stats_publish (struct activity *activity);
+
 /* Starting with ACTIVITY and for each direct ancestor execute CODE.
    Modifies ACTIVITY.  */
 #define activity_for_each_ancestor(__fea_activity, __fea_code)		\
@@ -23,6 +23,7 @@
 #include "mutex.h"
 
 #include <assert.h>
+#include <atomic.h>
 #include <profile.h>
 
 #include "ager.h"
@@ -33,6 +34,7 @@
 #include "thread.h"
 #include "pager.h"
 #include "messenger.h"
+#include "timer.h"
 
 #define MIN(x,y) ((x) < (y) ? (x) : (y))
 #define MAX(x,y) ((x) > (y) ? (x) : (y))
@@ -401,6 +403,8 @@ update_stats (void)
     memset (ACTIVITY_STATS (activity),
 	    0, sizeof (*ACTIVITY_STATS (activity)));
 
+    activity_stats_publish (activity);
+
     /* Wake anyone waiting for this statistic.  */
     struct messenger *messenger;
     object_wait_queue_for_each (activity, (struct vg_object *) activity,
@@ -438,19 +442,90 @@ update_stats (void)
 }
 
 
+/* A pass over all frames is split into AGER_SLICES slices, each of
+   which is processed in its own tick.  This bounds how long a tick
+   contends for KERNEL_LOCK.  */
+#define AGER_SLICES 4
+
+/* The time between ticks when there is memory pressure.  A pass then
+   takes 250 ms (=> ~4Hz).  */
+#define AGER_TICK ((1 << 18) / AGER_SLICES)
+
+/* When there is no memory pressure, the information the ager
+   gathers is less valuable.  We then make a pass AGER_IDLE_SLOWDOWN
+   times less often.  */
+#define AGER_IDLE_SLOWDOWN 2
+
+/* Whether the ager thread is waiting for AGER_TIMER (or is about to).
+   Whoever changes it from true to false owns the wake up and sends
+   the ager thread a message.  */
+static int ager_idle;
+
+/* Expires when the ager should process its next slice.  */
+static struct timer ager_timer;
+
+/* Called by the server thread with KERNEL_LOCK held.  */
+static void
+ager_tick (struct timer *timer)
+{
+  if (! atomic_exchange_acq (&ager_idle, false))
+    return;
+
+  /* Only touch the message tag and restore it afterwards.  The ager
+     thread is not holding any locks so this won't block for long.  */
+  l4_msg_tag_t tag = l4_msg_tag ();
+  l4_set_msg_tag (l4_niltag);
+  l4_send (ager_tid);
+  l4_set_msg_tag (tag);
+}
+
+/* Return the first frame at or after FRAME, but before LIMIT, that
+   the ager needs to examine, or LIMIT if there is none.  */
+static int
+next_aged (int frame, int limit)
+{
+  while (frame < limit)
+    {
+      if ((frame & 7) == 0 && ! object_descs_aged[frame / 8])
+	/* Skip the whole byte.  */
+	frame += 8;
+      else if (bit_test (object_descs_aged, frame))
+	return frame;
+      else
+	frame ++;
+    }
+
+  return limit;
+}
+
 void
 ager_loop (void)
 {
   debug (3, "Ager loop running");
 
-  /* 250 ms (=> ~4Hz).  */
-  l4_time_t timeout = l4_time_period (1 << 18);
+  int frames = object_descs_count;
+  int slice_size = (frames + AGER_SLICES - 1) / AGER_SLICES;
+
+  /* The next frame to examine.  */
+  int frame = 0;
 
-  int frames = (last_frame - first_frame + PAGESIZE) / PAGESIZE;
+  /* Statistics for the current pass.  */
+  int shared_unmapped = 0;
+  int became_inactive = 0;
+  int became_active = 0;
+  int active = 0;
+  int inactive = 0;
+  /* The time spent in the current pass, in microseconds.  */
+  uint64_t pass_time = 0;
 
   for (;;)
     {
-      int frame = 0;
+      int slice_end = frame + slice_size;
+      if (slice_end > frames)
+	slice_end = frames;
+
+      uint64_t slice_start_time = l4_system_clock ();
+      profile_start ((uintptr_t) &ager_loop + 2, "ager slice", NULL);
 
 #define BATCH_SIZE (L4_NUM_MRS / 2)
       struct object_desc *descs[BATCH_SIZE];
@@ -459,27 +534,26 @@ ager_loop (void)
 
       bool also_unmap;
 
-      int shared_unmapped = 0;
-
       /* We try to batch calls to l4_unmap, hence the acrobatics.  */
 
-      /* Grab a batch of live objects starting with object I.  */
+      /* Grab a batch of live objects starting with object FRAME.
+	 Only objects that are live and not eviction candidates
+	 (eviction candidates are unmapped: don't waste our time) are
+	 marked in OBJECT_DESCS_AGED.  */
       int grab (void)
       {
 	also_unmap = false;
 
 	int count;
-	for (count = 0; frame < frames && count < BATCH_SIZE; frame ++)
+	for (count = 0;
+	     (frame = next_aged (frame, slice_end)) < slice_end
+	       && count < BATCH_SIZE;
+	     frame ++)
 	  {
 	    struct object_desc *desc = &object_descs[frame];
 
-	    if (! desc->live)
-	      /* The object is not live.  */
-	      continue;
-	    if (desc->eviction_candidate)
-	      /* Eviction candidates are unmapped.  Don't waste our
-		 time.  */
-	      continue;
+	    assert (desc->live);
+	    assert (! desc->eviction_candidate);
 
 	    assertx (desc->activity,
 		     "OID: " VG_OID_FMT " (%s), age: %d",
@@ -512,12 +586,7 @@ ager_loop (void)
 	return count;
       }
 
-      int became_inactive = 0;
-      int became_active = 0;
-      int active = 0;
-      int inactive = 0;
-
-      while (frame < frames)
+      while (frame < slice_end)
 	{
 	  ss_mutex_lock (&kernel_lock);
 	  profile_start ((uintptr_t) &ager_loop, "ager", NULL);
@@ -660,31 +729,63 @@ ager_loop (void)
 	  ss_mutex_unlock (&kernel_lock);
 	}
 
-      /* Update statistics every two seconds.  */
-      if (period % FREQ == 0)
-	{
-	  update_stats ();
+      profile_end ((uintptr_t) &ager_loop + 2);
+      pass_time += l4_system_clock () - slice_start_time;
 
-	  do_debug (1)
+      if (frame == frames)
+	/* The pass is complete.  */
+	{
+	  /* Update statistics every FREQ passes (every two seconds
+	     under memory pressure).  */
+	  if (period % FREQ == 0)
 	    {
-	      /* Make the print atomic.  */
-	      ss_mutex_lock (&kernel_lock);
-	      int a = zalloc_memory + available_list_count (&available);
-	      debug (0, "%d: %d of %d (%d%%) free; laundry: %d; "
-		     "%d active (%d new); %d inactive (%d new), "
-		     "%d shared unmapped",
-		     period / FREQ,
-		     a, memory_total, (a * 100) / memory_total,
-		     laundry_list_count (&laundry),
-		     active, became_active, inactive, became_inactive,
-		     shared_unmapped);
-	      ss_mutex_unlock (&kernel_lock);
+	      update_stats ();
+
+	      do_debug (1)
+		{
+		  /* Make the print atomic.  */
+		  ss_mutex_lock (&kernel_lock);
+		  int a = zalloc_memory + available_list_count (&available);
+		  int allocs = zalloc_magazine_stats.hits
+		    + zalloc_magazine_stats.misses;
+		  debug (0, "%d: %d of %d (%d%%) free; laundry: %d; "
+			 "%d active (%d new); %d inactive (%d new), "
+			 "%d shared unmapped; pass took %lld us; "
+			 "magazine hits: %d%%",
+			 period / FREQ,
+			 a, memory_total, (a * 100) / memory_total,
+			 laundry_list_count (&laundry),
+			 active, became_active, inactive, became_inactive,
+			 shared_unmapped, pass_time,
+			 allocs ? (zalloc_magazine_stats.hits * 100) / allocs
+			 : 0);
+		  ss_mutex_unlock (&kernel_lock);
+		}
 	    }
+	  period ++;
+
+	  frame = 0;
+	  shared_unmapped = 0;
+	  became_inactive = 0;
+	  became_active = 0;
+	  active = 0;
+	  inactive = 0;
+	  pass_time = 0;
 	}
-      period ++;
 
-      /* Wait TIMEOUT or until we are interrupted by the main
-	 thread.  */
-      l4_receive_timeout (viengoos_tid, timeout);
+      /* Adapt the scan rate to the memory pressure.  */
+      ss_mutex_lock (&kernel_lock);
+      bool pressure = pager_collect_needed () > 0;
+      timer_add (&ager_timer,
+		 l4_system_clock ()
+		 + AGER_TICK * (pressure ? 1 : AGER_IDLE_SLOWDOWN),
+		 ager_tick);
+      ager_idle = true;
+      ss_mutex_unlock (&kernel_lock);
+
+      /* Wait until we are woken by ager_tick.  We can't wait on
+	 anything else: waking a thread waiting on KERNEL_LOCK would
+	 confuse the lock.  */
+      l4_receive (viengoos_tid);
     }
 }
@@ -0,0 +1,103 @@
+/* backing-store-file.c - A backing store on a host file.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This driver is only usable in the test environment: it stores
+   objects in a file on the host.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <hurd/stddef.h>
+
+#include "backing-store.h"
+
+/* The file used if none is specified.  */
+#define DEFAULT_FILE "viengoos.store"
+
+static error_t
+file_init (struct backing_store_driver *driver, const char *cfg)
+{
+  int fd = open (cfg ?: DEFAULT_FILE, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    return errno;
+
+  driver->cookie = fd;
+  return 0;
+}
+
+static error_t
+file_write (struct backing_store_driver *driver, int count,
+	    const vg_oid_t oids[], void *const pages[])
+{
+  int fd = driver->cookie;
+
+  /* Write runs of consecutive objects using a single system
+     call.  */
+  int i = 0;
+  while (i < count)
+    {
+      struct iovec iov[count - i];
+
+      int run = 0;
+      do
+	{
+	  iov[run].iov_base = pages[i + run];
+	  iov[run].iov_len = PAGESIZE;
+	  run ++;
+	}
+      while (i + run < count && oids[i + run] == oids[i] + run);
+
+      ssize_t len = pwritev (fd, iov, run, (off_t) oids[i] * PAGESIZE);
+      if (len < 0)
+	return errno;
+      if (len != run * PAGESIZE)
+	return EIO;
+
+      i += run;
+    }
+
+  return 0;
+}
+
+static error_t
+file_read (struct backing_store_driver *driver, vg_oid_t oid, void *page)
+{
+  int fd = driver->cookie;
+
+  ssize_t len = pread (fd, page, PAGESIZE, (off_t) oid * PAGESIZE);
+  if (len < 0)
+    return errno;
+  if (len != PAGESIZE)
+    return EIO;
+
+  return 0;
+}
+
+struct backing_store_driver file_backing_store =
+  {
+    "file",
+    file_init,
+    file_write,
+    file_read
+  };
@@ -0,0 +1,455 @@
+/* backing-store.c - Backing store implementation.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <md5.h>
+#include <hurd/stddef.h>
+
+#include "backing-store.h"
+#include "object.h"
+#include "activity.h"
+#include "profile.h"
+
+#ifdef _L4_TEST_ENVIRONMENT
+extern struct backing_store_driver file_backing_store;
+#endif
+
+struct backing_store_driver *backing_store_drivers[] =
+  {
+#ifdef _L4_TEST_ENVIRONMENT
+    &file_backing_store,
+#endif
+    0
+  };
+
+struct backing_store_driver *backing_store;
+
+/* The instance of the active driver.  */
+static struct backing_store_driver backing_store_instance;
+
+bool
+backing_store_init (const char *conf)
+{
+  assert (conf);
+
+  const char *driver_args = NULL;
+
+  struct backing_store_driver **drv;
+  for (drv = &backing_store_drivers[0]; *drv; drv ++)
+    {
+      unsigned int name_len = strlen ((*drv)->name);
+      if (strncmp (conf, (*drv)->name, name_len) == 0
+	  && (conf[name_len] == 0 || conf[name_len] == ','))
+	{
+	  if (conf[name_len])
+	    driver_args = &conf[name_len + 1];
+	  break;
+	}
+    }
+  if (! *drv)
+    return false;
+
+  backing_store_instance = **drv;
+  if (backing_store_instance.init)
+    {
+      error_t err = backing_store_instance.init (&backing_store_instance,
+						 driver_args);
+      if (err)
+	{
+	  debug (0, "Failed to initialize backing store %s: %d",
+		 conf, err);
+	  return false;
+	}
+    }
+
+  backing_store = &backing_store_instance;
+
+  debug (1, "Using backing store %s", conf);
+
+  return true;
+}
+
+/* Compute the checksum of the page PAGE and store it in SUM.  */
+static void
+checksum (void *page, uint64_t sum[2])
+{
+  build_assert (sizeof (uint64_t[2]) == 16);
+  md5_buffer (page, PAGESIZE, sum);
+}
+
+error_t
+backing_store_write (struct vg_folio *folio, int count,
+		     struct object_desc *descs[])
+{
+  assert (backing_store);
+  assert (0 < count && count <= VG_FOLIO_OBJECTS);
+
+  vg_oid_t foid = object_oid ((struct vg_object *) folio);
+
+  vg_oid_t oids[count];
+  void *pages[count];
+
+  int i;
+  for (i = 0; i < count; i ++)
+    {
+      assert (descs[i]->live);
+      assert (foid < descs[i]->oid
+	      && descs[i]->oid <= foid + VG_FOLIO_OBJECTS);
+      assert (i == 0 || descs[i - 1]->oid < descs[i]->oid);
+
+      oids[i] = descs[i]->oid;
+      pages[i] = object_desc_to_object (descs[i]);
+    }
+
+  error_t err = backing_store->write (backing_store, count, oids, pages);
+  if (err)
+    {
+      debug (0, "Writing %d objects of folio " VG_OID_FMT " failed: %d",
+	     count, VG_OID_PRINTF (foid), err);
+      return err;
+    }
+
+  for (i = 0; i < count; i ++)
+    {
+      int offset = descs[i]->oid - foid - 1;
+
+      checksum (pages[i], folio->checksums[offset + 1]);
+      folio_object_content_set (folio, offset, true);
+
+      descs[i]->dirty = false;
+    }
+
+  return 0;
+}
+
+error_t
+backing_store_read (struct vg_folio *folio, int offset,
+		    struct vg_object *object)
+{
+  assert (0 <= offset && offset < VG_FOLIO_OBJECTS);
+  assert (folio_object_content (folio, offset));
+
+  if (! backing_store)
+    return ENOENT;
+
+  vg_oid_t oid = object_oid ((struct vg_object *) folio) + 1 + offset;
+
+  error_t err = backing_store->read (backing_store, oid, object);
+  if (err)
+    {
+      debug (0, "Reading " VG_OID_FMT " failed: %d",
+	     VG_OID_PRINTF (oid), err);
+      return err;
+    }
+
+  uint64_t sum[2];
+  checksum (object, sum);
+  if (sum[0] != folio->checksums[offset + 1][0]
+      || sum[1] != folio->checksums[offset + 1][1])
+    {
+      debug (0, VG_OID_FMT ": checksum mismatch "
+	     "(expected %llx%016llx, got %llx%016llx)",
+	     VG_OID_PRINTF (oid),
+	     folio->checksums[offset + 1][0], folio->checksums[offset + 1][1],
+	     sum[0], sum[1]);
+      return EIO;
+    }
+
+  return 0;
+}
+
+/* The batches that have been filled but not yet committed.  */
+static struct backing_store_batch *batches_in_flight;
+
+/* Whether the object OID is part of a batch that has been filled but
+   not yet committed.  */
+static bool
+in_flight (vg_oid_t oid)
+{
+  struct backing_store_batch *batch;
+  for (batch = batches_in_flight; batch; batch = batch->next)
+    {
+      /* The batch is sorted by OID.  */
+      int lo = 0;
+      int hi = batch->count;
+      while (lo < hi)
+	{
+	  int mid = lo + (hi - lo) / 2;
+	  if (batch->oids[mid] < oid)
+	    lo = mid + 1;
+	  else if (batch->oids[mid] > oid)
+	    hi = mid;
+	  else
+	    return true;
+	}
+    }
+
+  return false;
+}
+
+/* Whether the object designated by DESC may be written to backing
+   store.  Objects which embed kernel state are currently kept in
+   memory.  */
+static bool
+launderable (struct object_desc *desc)
+{
+  if (desc->laundering)
+    /* The object is already being written.  */
+    return false;
+
+  if (in_flight (desc->oid))
+    /* An older version of the object is being written, e.g., the
+       object was claimed or reallocated since the laundry thread
+       selected it.  Writes to the same location must not overlap:
+       the older one could land last and the object on backing store
+       would then not match the checksum recorded by the newer
+       one.  */
+    return false;
+
+  switch (desc->type)
+    {
+    case vg_cap_page:
+    case vg_cap_rpage:
+    case vg_cap_cappage:
+    case vg_cap_rcappage:
+      return true;
+    default:
+      return false;
+    }
+}
+
+/* DESC has been written to backing store.  Detach it from the
+   laundry and, if it is an eviction candidate, make it available.  */
+static void
+laundered (struct object_desc *desc)
+{
+  laundry_list_unlink (&laundry, desc);
+
+  if (! desc->eviction_candidate)
+    /* An optimistic sync.  The object remains on its owner's LRU
+       lists.  */
+    return;
+
+  struct activity *activity = desc->activity;
+  assert (activity);
+
+  eviction_list_unlink (&activity->eviction_dirty, desc);
+  eviction_list_enqueue (&activity->eviction_clean, desc);
+  available_list_enqueue (&available, desc);
+
+  /* The frame no longer counts against ACTIVITY: clean eviction
+     candidates are immediately reclaimable.  */
+  activity->frames_local --;
+
+  struct activity *ancestor = activity;
+  activity_for_each_ancestor
+    (ancestor,
+     ({
+       ancestor->frames_total --;
+       ancestor->frames_pending_eviction --;
+     }));
+}
+
+int
+backing_store_batch_fill (struct backing_store_batch *batch, int goal)
+{
+  assert (backing_store);
+
+  if (goal > BACKING_STORE_BATCH_OBJECTS)
+    goal = BACKING_STORE_BATCH_OBJECTS;
+
+  batch->count = 0;
+  batch->err = 0;
+
+  void add (struct object_desc *desc)
+  {
+    /* Make sure we also collect any modifications made since the
+       object was placed on the laundry.  */
+    object_desc_flush (desc, true);
+
+    struct vg_object *object = object_desc_to_object (desc);
+
+    /* Insertion sort by OID so that the driver sees a sequential
+       write.  */
+    int i;
+    for (i = batch->count; i > 0 && batch->oids[i - 1] > desc->oid; i --)
+      {
+	batch->descs[i] = batch->descs[i - 1];
+	batch->oids[i] = batch->oids[i - 1];
+	batch->pages[i] = batch->pages[i - 1];
+	memcpy (batch->checksums[i], batch->checksums[i - 1],
+		sizeof (batch->checksums[i]));
+      }
+    batch->descs[i] = desc;
+    batch->oids[i] = desc->oid;
+    batch->pages[i] = object;
+    checksum (object, batch->checksums[i]);
+    batch->count ++;
+
+    desc->laundering = true;
+
+    /* Until the write completes, the copy on backing store is not
+       valid.  */
+    folio_object_content_set (objects_folio (desc->activity, object),
+			      objects_folio_offset (object), false);
+  }
+
+  struct object_desc *seed;
+  for (seed = laundry_list_head (&laundry);
+       seed && batch->count < goal;
+       seed = laundry_list_next (seed))
+    {
+      if (! launderable (seed))
+	continue;
+
+      /* Gather the objects on the laundry that belong to the same
+	 folio as SEED.  */
+      vg_oid_t foid = seed->oid - seed->oid % (VG_FOLIO_OBJECTS + 1);
+
+      add (seed);
+
+      struct object_desc *desc;
+      for (desc = laundry_list_next (seed);
+	   desc && batch->count < goal;
+	   desc = laundry_list_next (desc))
+	if (foid < desc->oid && desc->oid <= foid + VG_FOLIO_OBJECTS
+	    && launderable (desc))
+	  add (desc);
+    }
+
+  if (batch->count > 0)
+    {
+      batch->next = batches_in_flight;
+      batches_in_flight = batch;
+    }
+
+  return batch->count;
+}
+
+void
+backing_store_batch_write (struct backing_store_batch *batch)
+{
+  assert (backing_store);
+  assert (batch->count > 0);
+
+  batch->err = backing_store->write (backing_store, batch->count,
+				     batch->oids, batch->pages);
+  if (batch->err)
+    debug (0, "Writing %d objects (" VG_OID_FMT "-" VG_OID_FMT ") "
+	   "failed: %d",
+	   batch->count, VG_OID_PRINTF (batch->oids[0]),
+	   VG_OID_PRINTF (batch->oids[batch->count - 1]), batch->err);
+}
+
+int
+backing_store_batch_commit (struct backing_store_batch *batch)
+{
+  struct backing_store_batch **prevp;
+  for (prevp = &batches_in_flight; *prevp != batch;
+       prevp = &(*prevp)->next)
+    assert (*prevp);
+  *prevp = batch->next;
+
+  int cleaned = 0;
+  int stale = 0;
+
+  int i;
+  for (i = 0; i < batch->count; i ++)
+    {
+      struct object_desc *desc = batch->descs[i];
+
+      if (! desc->live || desc->oid != batch->oids[i] || ! desc->laundering)
+	/* The object was claimed or destroyed while it was being
+	   written.  */
+	{
+	  stale ++;
+	  continue;
+	}
+
+      desc->laundering = false;
+
+      if (batch->err)
+	continue;
+
+      struct vg_object *object = object_desc_to_object (desc);
+
+      /* The kernel may have modified the object while we were not
+	 holding KERNEL_LOCK.  In that case, what we wrote may be
+	 torn.  */
+      uint64_t sum[2];
+      checksum (object, sum);
+      if (sum[0] != batch->checksums[i][0]
+	  || sum[1] != batch->checksums[i][1])
+	{
+	  stale ++;
+	  continue;
+	}
+
+      struct vg_folio *folio = objects_folio (desc->activity, object);
+      int offset = objects_folio_offset (object);
+
+      memcpy (folio->checksums[offset + 1], sum, sizeof (sum));
+      folio_object_content_set (folio, offset, true);
+      desc->dirty = false;
+
+      laundered (desc);
+      cleaned ++;
+    }
+
+  debug (5, "Laundered %d of %d objects (%d stale, %d remain on laundry)",
+	 cleaned, batch->count, stale, laundry_list_count (&laundry));
+
+  return cleaned;
+}
+
+int
+backing_store_launder (int goal)
+{
+  if (! backing_store)
+    return 0;
+
+  profile_start ((uintptr_t) &backing_store_launder, __FUNCTION__, NULL);
+
+  /* KERNEL_LOCK serializes access.  */
+  static struct backing_store_batch batch;
+
+  int cleaned = 0;
+  while (cleaned < goal)
+    {
+      if (! backing_store_batch_fill (&batch, goal - cleaned))
+	break;
+
+      backing_store_batch_write (&batch);
+      int count = backing_store_batch_commit (&batch);
+      cleaned += count;
+
+      if (batch.err || count == 0)
+	break;
+    }
+
+  profile_end ((uintptr_t) &backing_store_launder);
+
+  return cleaned;
+}
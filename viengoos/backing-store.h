@@ -0,0 +1,144 @@
+/* backing-store.h - Backing store interface.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef VIENGOOS_BACKING_STORE_H
+#define VIENGOOS_BACKING_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <hurd/error.h>
+#include <viengoos/cap.h>
+#include <viengoos/folio.h>
+
+#include "object.h"
+
+/* A backing store holds the content of objects that are not in
+   memory.  Objects are addressed by their OID: the object OID is
+   stored at byte offset OID * PAGESIZE.  A folio's header is thus
+   immediately followed by its VG_FOLIO_OBJECTS objects.
+
+   Every backing store driver must provide the following
+   operations.  */
+struct backing_store_driver
+{
+  const char *name;
+
+  /* Initialize the backing store.  CFG is the driver specific part
+     of the configuration string, or NULL.  Returns 0 on success.  */
+  error_t (*init) (struct backing_store_driver *driver, const char *cfg);
+
+  /* Write the COUNT objects PAGES[0..COUNT - 1] to backing store.
+     OIDS[I] is the OID of the object stored in PAGES[I].  OIDS is
+     sorted in ascending order; the objects may belong to different
+     folios.  This may be called without KERNEL_LOCK held.  Returns 0
+     on success.  */
+  error_t (*write) (struct backing_store_driver *driver, int count,
+		    const vg_oid_t oids[], void *const pages[]);
+
+  /* Read the object OID from backing store into PAGE.  Returns 0 on
+     success.  */
+  error_t (*read) (struct backing_store_driver *driver, vg_oid_t oid,
+		   void *page);
+
+  uintptr_t cookie;
+};
+
+/* A list of all backing store drivers, terminated by a null
+   pointer.  The only driver, "file", is for the test environment, so
+   in the kernel the list is empty.  */
+extern struct backing_store_driver *backing_store_drivers[];
+
+/* The active backing store or NULL if there is none.  */
+extern struct backing_store_driver *backing_store;
+
+/* Activate the backing store described by CONF.  CONF has the
+   pattern NAME[,CONFIG...], for example "file,/tmp/viengoos.store".
+   Returns false if CONF does not name a valid driver or the driver
+   could not be initialized.  */
+extern bool backing_store_init (const char *conf);
+
+/* Write the COUNT objects designated by DESCS to backing store.  The
+   objects must all belong to the folio FOLIO and DESCS must be sorted
+   by OID.  On success, marks each object as having content, records
+   its checksum in FOLIO and clears each descriptor's dirty bit.  The
+   caller is responsible for moving the descriptors to the
+   appropriate lists.  Returns 0 on success.  */
+extern error_t backing_store_write (struct vg_folio *folio, int count,
+				    struct object_desc *descs[]);
+
+/* Read the object at offset OFFSET in the folio FOLIO from backing
+   store into OBJECT and verify it against the checksum recorded in
+   FOLIO.  Returns 0 on success.  */
+extern error_t backing_store_read (struct vg_folio *folio, int offset,
+				   struct vg_object *object);
+
+/* The maximum number of objects in a laundry batch.  */
+#define BACKING_STORE_BATCH_OBJECTS (4 * VG_FOLIO_OBJECTS)
+
+/* A batch of objects taken from the laundry and being written to
+   backing store.  */
+struct backing_store_batch
+{
+  int count;
+  struct object_desc *descs[BACKING_STORE_BATCH_OBJECTS];
+  /* The OID of each object when it was added to the batch.  */
+  vg_oid_t oids[BACKING_STORE_BATCH_OBJECTS];
+  void *pages[BACKING_STORE_BATCH_OBJECTS];
+  /* The checksum of each object when it was added to the batch.  */
+  uint64_t checksums[BACKING_STORE_BATCH_OBJECTS][2];
+  /* The result of the write.  */
+  error_t err;
+
+  /* The next batch that has been filled but not yet committed.  */
+  struct backing_store_batch *next;
+};
+
+/* Fill BATCH with up to GOAL objects from the laundry.  The objects
+   of a folio are taken together and the batch is sorted by OID so
+   that the driver sees a mostly sequential write.  Each selected
+   object is marked as being laundered.  An object that is part of
+   another batch that has not yet been committed is not selected.
+   Returns the number of objects in the batch.  If it is not zero,
+   the batch must be committed using backing_store_batch_commit.
+   Must be called with KERNEL_LOCK held.  */
+extern int backing_store_batch_fill (struct backing_store_batch *batch,
+				     int goal);
+
+/* Write the objects in BATCH to backing store.  Need not (and, if
+   the write may block, should not) be called with KERNEL_LOCK
+   held.  */
+extern void backing_store_batch_write (struct backing_store_batch *batch);
+
+/* Complete the write of BATCH.  Each object that was successfully
+   written, has not been claimed in the meantime and whose content is
+   unchanged is marked clean, and, if it is an eviction candidate,
+   moved from the laundry to the available list.  Other objects
+   remain on the laundry.  Returns the number of objects cleaned.
+   Must be called with KERNEL_LOCK held.  */
+extern int backing_store_batch_commit (struct backing_store_batch *batch);
+
+/* Synchronously write up to GOAL objects on the laundry list to
+   backing store and move the written objects to the available list.
+   Returns the number of objects cleaned.  Must be called with
+   KERNEL_LOCK held.  Normally, the laundry thread does this without
+   holding KERNEL_LOCK during the I/O; this is a fallback for when
+   memory is exhausted.  */
+extern int backing_store_launder (int goal);
+
+#endif
@@ -19,3 +19,54 @@
 # Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA.
 
 HURD_LOAD_ADDRESS(rm, 0x400000)
+
+AC_ARG_WITH([replacement-policy],
+	    AC_HELP_STRING([--with-replacement-policy=POLICY],
+			   [Viengoos's frame replacement policy: fifo (default), once or aging]),
+	    [ac_cv_replacement_policy=$withval],
+	    [ac_cv_replacement_policy=fifo])
+case $ac_cv_replacement_policy in
+  fifo)
+    replacement_policy=REPLACEMENT_FIFO
+    ;;
+  once)
+    replacement_policy=REPLACEMENT_ONCE
+    ;;
+  aging)
+    replacement_policy=REPLACEMENT_AGING
+    ;;
+  *)
+    AC_MSG_ERROR([invalid value passed to --with-replacement-policy])
+    ;;
+esac
+AC_DEFINE_UNQUOTED([REPLACEMENT_POLICY], [$replacement_policy],
+		   [Define to the frame replacement policy Viengoos uses.])
+
+AC_ARG_WITH([zalloc-engine],
+	    AC_HELP_STRING([--with-zalloc-engine=ENGINE],
+			   [Viengoos's physical memory zone engine: list (default) or bitmap]),
+	    [ac_cv_zalloc_engine=$withval],
+	    [ac_cv_zalloc_engine=list])
+case $ac_cv_zalloc_engine in
+  list)
+    zalloc_engine=ZALLOC_LIST
+    ;;
+  bitmap)
+    zalloc_engine=ZALLOC_BITMAP
+    ;;
+  *)
+    AC_MSG_ERROR([invalid value passed to --with-zalloc-engine])
+    ;;
+esac
+AC_DEFINE_UNQUOTED([ZALLOC_DEFAULT_ENGINE], [$zalloc_engine],
+		   [Define to the zone engine Viengoos's zalloc uses.])
+
+AC_ARG_ENABLE([superpages],
+	      AC_HELP_STRING([--enable-superpages],
+			     [map aligned groups of a folio's pages with a single fpage]),
+	      [ac_cv_superpages=$enableval],
+	      [ac_cv_superpages=no])
+if test "x$ac_cv_superpages" = xyes; then
+  AC_DEFINE([SUPERPAGES], [1],
+	    [Define to reserve frames for and map superpages.])
+fi
@@ -0,0 +1,158 @@
+/* futex.c - Futex wait queue implementation.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <l4.h>
+#include <errno.h>
+#include <assert.h>
+#include <hurd/stddef.h>
+
+#include "futex.h"
+#include "object.h"
+#include "messenger.h"
+#include "output.h"
+
+static struct futex_bucket_list futex_hash[FUTEX_HASH_SIZE];
+
+static struct futex_bucket_list *
+futex_bucket (vg_oid_t oid, int offset)
+{
+  /* Futexes are word aligned.  */
+  uint32_t h = (uint32_t) oid * 0x9e3779b1 ^ (offset >> 2);
+  return &futex_hash[(h ^ (h >> 16)) % FUTEX_HASH_SIZE];
+}
+
+error_t
+futex_wait (struct activity *activity,
+	    struct vg_object *object, int offset,
+	    const struct timespec *timeout,
+	    struct messenger *messenger)
+{
+  uint64_t deadline = 0;
+  if (timeout)
+    {
+      if (timeout->tv_sec < 0 || timeout->tv_nsec < 0
+	  || timeout->tv_nsec >= 1000000000)
+	return EINVAL;
+
+      uint64_t us = (uint64_t) timeout->tv_sec * 1000000
+	+ timeout->tv_nsec / 1000;
+      if (us == 0)
+	return ETIMEDOUT;
+
+      deadline = l4_system_clock () + us;
+    }
+
+  vg_oid_t oid = object_to_object_desc (object)->oid;
+
+  messenger->wait_reason = MESSENGER_WAIT_FUTEX;
+  messenger->wait_reason_arg = offset;
+  messenger->futex_oid = oid;
+
+  object_wait_queue_enqueue (activity, object, messenger);
+  futex_bucket_list_enqueue (futex_bucket (oid, offset), messenger);
+#ifndef NDEBUG
+  futex_waiter_list_enqueue (&futex_waiters, messenger);
+#endif
+
+  if (deadline)
+    messenger_timeout (messenger, deadline);
+
+  return 0;
+}
+
+void
+futex_unlink (struct messenger *messenger)
+{
+  assert (messenger->wait_reason == MESSENGER_WAIT_FUTEX);
+
+  futex_bucket_list_unlink (futex_bucket (messenger->futex_oid,
+					  messenger->wait_reason_arg),
+			    messenger);
+}
+
+int
+futex_wake (struct activity *activity,
+	    int to_wake, struct vg_object *object1, int offset1,
+	    int to_requeue, struct vg_object *object2, int offset2)
+{
+  vg_oid_t oid1 = object_to_object_desc (object1)->oid;
+  vg_oid_t oid2 = 0;
+  if (to_requeue)
+    oid2 = object_to_object_desc (object2)->oid;
+
+  /* Requeued messengers are only added to their new bucket after the
+     walk: if it is the bucket being walked, they would otherwise be
+     visited again.  */
+  struct futex_bucket_list requeued;
+  futex_bucket_list_init (&requeued, "requeued");
+
+  int count = 0;
+  struct messenger *m;
+  struct messenger *next;
+  for (m = futex_bucket_list_head (futex_bucket (oid1, offset1));
+       m && (to_wake > 0 || to_requeue > 0);
+       m = next)
+    {
+      next = futex_bucket_list_next (m);
+
+      if (m->futex_oid != oid1 || m->wait_reason_arg != offset1)
+	/* A different futex in the same bucket.  */
+	continue;
+
+      /* object_wait_queue_unlink cancels the timeout.  A requeued
+	 waiter keeps it.  */
+      uint64_t deadline = 0;
+      if (timer_pending (&m->timeout))
+	deadline = m->timeout.deadline;
+      object_wait_queue_unlink (activity, m);
+
+      if (to_wake > 0)
+	{
+	  debug (5, "Waking messenger");
+
+	  error_t err = vg_futex_reply (activity, m, 0);
+	  if (err)
+	    panic ("Error vg_futex waking: %d", err);
+
+	  to_wake --;
+	}
+      else
+	{
+	  m->wait_reason = MESSENGER_WAIT_FUTEX;
+	  m->wait_reason_arg = offset2;
+	  m->futex_oid = oid2;
+
+	  object_wait_queue_enqueue (activity, object2, m);
+	  futex_bucket_list_enqueue (&requeued, m);
+#ifndef NDEBUG
+	  futex_waiter_list_enqueue (&futex_waiters, m);
+#endif
+	  if (deadline)
+	    messenger_timeout (m, deadline);
+
+	  to_requeue --;
+	}
+
+      count ++;
+    }
+
+  futex_bucket_list_join (futex_bucket (oid2, offset2), &requeued);
+
+  return count;
+}
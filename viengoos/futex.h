@@ -0,0 +1,63 @@
+/* futex.h - Futex wait queue interface.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef VIENGOOS_FUTEX_H
+#define VIENGOOS_FUTEX_H
+
+#include <stdint.h>
+#include <viengoos/futex.h>
+
+#include "object.h"
+#include "messenger.h"
+
+/* A messenger waiting on a futex is enqueued on the wait queue of the
+   page containing the futex (so that it is woken with EFAULT if the
+   page is destroyed) and, additionally, on a bucket of a hash table
+   keyed by the page's OID and the futex's offset.  Waking and
+   requeuing only examine the messengers in the futex's bucket, not
+   every messenger waiting on the page.
+
+   A timed wait uses a messenger timeout (see messenger_timeout): when
+   the deadline passes, the messenger is removed from the wait queue
+   and sent ETIMEDOUT.  */
+#define FUTEX_HASH_SIZE 256
+
+/* Enqueue MESSENGER on OBJECT, a page, as a waiter on the futex at
+   byte offset OFFSET.  If TIMEOUT is not NULL, the wait times out
+   after the relative time *TIMEOUT.  If *TIMEOUT has already elapsed,
+   MESSENGER is not enqueued and ETIMEDOUT is returned.  */
+extern error_t futex_wait (struct activity *activity,
+			   struct vg_object *object, int offset,
+			   const struct timespec *timeout,
+			   struct messenger *messenger);
+
+/* Wake up to TO_WAKE messengers waiting on the futex at offset OFFSET1
+   in OBJECT1.  Then, move up to TO_REQUEUE of the remaining waiters
+   to the futex at offset OFFSET2 in OBJECT2.  Returns the number of
+   messengers woken and requeued.  */
+extern int futex_wake (struct activity *activity,
+		       int to_wake, struct vg_object *object1, int offset1,
+		       int to_requeue, struct vg_object *object2, int offset2);
+
+/* MESSENGER, which is waiting on a futex, is being removed from its
+   object's wait queue.  Remove it from the futex hash.  Called by
+   object_wait_queue_unlink.  */
+extern void futex_unlink (struct messenger *messenger);
+
+#endif
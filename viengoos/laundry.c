@@ -0,0 +1,103 @@
+/* laundry.c - Laundry loop implementation.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <l4/ipc.h>
+#include <l4/schedule.h>
+#include "mutex.h"
+
+#include <assert.h>
+#include <profile.h>
+
+#include "laundry.h"
+#include "viengoos.h"
+#include "object.h"
+#include "zalloc.h"
+#include "backing-store.h"
+
+/* The reclaimer places dirty eviction candidates on the laundry.
+   Before their frames can be reused, they have to be written to
+   backing store.  The laundry thread does this in the background:
+   when memory gets tight, it takes a batch of objects from the
+   laundry, writes them out without holding KERNEL_LOCK and then
+   moves those that were not claimed in the meantime to the available
+   list.
+
+   The thread is only started if a backing store is configured.
+   There is not yet a driver for a real device: currently only the
+   test environment's file driver exists.  */
+
+/* The batch being written.  Only the laundry thread uses it.  */
+static struct backing_store_batch batch;
+
+void
+laundry_loop (void)
+{
+  debug (3, "Laundry loop running");
+
+  /* 32 ms.  */
+  l4_time_t timeout = l4_time_period (1 << 15);
+
+  /* Whether we are between the low and the high water marks.  */
+  bool cleaning = false;
+
+  for (;;)
+    {
+      for (;;)
+	{
+	  ss_mutex_lock (&kernel_lock);
+
+	  int avail = zalloc_memory + available_list_count (&available);
+	  if (avail < LAUNDRY_LOW_WATER_MARK)
+	    cleaning = true;
+	  else if (avail >= LAUNDRY_HIGH_WATER_MARK)
+	    cleaning = false;
+
+	  int count = 0;
+	  if (cleaning)
+	    {
+	      profile_start ((uintptr_t) &laundry_loop, "laundry", NULL);
+	      count = backing_store_batch_fill (&batch,
+						LAUNDRY_HIGH_WATER_MARK - avail);
+	      profile_end ((uintptr_t) &laundry_loop);
+	    }
+
+	  ss_mutex_unlock (&kernel_lock);
+
+	  if (count == 0)
+	    break;
+
+	  backing_store_batch_write (&batch);
+
+	  ss_mutex_lock (&kernel_lock);
+	  int cleaned = backing_store_batch_commit (&batch);
+
+	  debug (5, "Cleaned %d of %d objects; laundry: %d",
+		 cleaned, count, laundry_list_count (&laundry));
+	  ss_mutex_unlock (&kernel_lock);
+
+	  if (batch.err)
+	    /* Don't hammer a failing device.  */
+	    break;
+	}
+
+      /* Wait TIMEOUT or until we are interrupted by the main
+	 thread.  */
+      l4_receive_timeout (viengoos_tid, timeout);
+    }
+}
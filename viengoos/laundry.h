@@ -0,0 +1,39 @@
+/* laundry.h - Laundry thread interface.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef VIENGOOS_LAUNDRY_H
+#define VIENGOOS_LAUNDRY_H
+
+#include "pager.h"
+
+/* The laundry thread starts writing dirty objects to backing store
+   when the number of free and available frames drops below
+   LAUNDRY_LOW_WATER_MARK.  This is a bit above the pager's low water
+   mark so that, when the pager runs, it finds clean frames...  */
+#define LAUNDRY_LOW_WATER_MARK \
+  (PAGER_LOW_WATER_MARK + PAGER_LOW_WATER_MARK / 4)
+
+/* ... and continues until there are at least LAUNDRY_HIGH_WATER_MARK
+   free and available frames or the laundry is empty.  */
+#define LAUNDRY_HIGH_WATER_MARK PAGER_HIGH_WATER_MARK
+
+/* The laundry thread.  */
+void laundry_loop (void);
+
+#endif
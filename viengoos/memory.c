@@ -22,6 +22,9 @@
 #include "pager.h"
 #include "activity.h"
 #include "zalloc.h"
+#include "backing-store.h"
+#include "superpage.h"
+#include "messenger.h"
 
 #include <string.h>
 
@@ -41,6 +44,9 @@ uint32_t memory_total;
 l4_word_t first_frame;
 l4_word_t last_frame;
 
+struct memory_region memory_regions[MEMORY_REGIONS_MAX];
+int memory_regions_count;
+
 struct region
 {
   l4_word_t start;
@@ -299,6 +305,53 @@ memory_reservation_clear (enum memory_reservation type)
     }
 }
 
+/* Add the memory starting at byte START and continuing until byte END
+   to MEMORY_REGIONS.  */
+static void
+memory_region_record (l4_word_t start, l4_word_t end)
+{
+  int i;
+  for (i = 0; i < memory_regions_count; i ++)
+    if (memory_regions[i].end + 1 == start)
+      {
+	memory_regions[i].end = end;
+	return;
+      }
+    else if (end + 1 == memory_regions[i].start)
+      {
+	memory_regions[i].start = start;
+	return;
+      }
+
+  if (memory_regions_count < MEMORY_REGIONS_MAX)
+    {
+      memory_regions[memory_regions_count].start = start;
+      memory_regions[memory_regions_count].end = end;
+      memory_regions_count ++;
+      return;
+    }
+
+  /* Out of slots.  Grow the closest region to include this one.  */
+  int closest = 0;
+  l4_word_t closest_gap = -1;
+  for (i = 0; i < memory_regions_count; i ++)
+    {
+      l4_word_t gap = (start > memory_regions[i].end
+		       ? start - memory_regions[i].end
+		       : memory_regions[i].start - end);
+      if (gap < closest_gap)
+	{
+	  closest = i;
+	  closest_gap = gap;
+	}
+    }
+
+  if (start < memory_regions[closest].start)
+    memory_regions[closest].start = start;
+  if (end > memory_regions[closest].end)
+    memory_regions[closest].end = end;
+}
+
 void
 memory_grab (void)
 {
@@ -313,17 +366,22 @@ memory_grab (void)
       if (first)
 	first = false;
 
+      memory_region_record (addr, addr + length - 1);
       memory_add (addr, addr + length - 1);
     }
 
 #ifdef _L4_TEST_ENVIRONMENT
-#define SIZE 8 * 1024 * 1024
-  void *m = mmap (NULL, SIZE, PROT_READ | PROT_WRITE,
+  /* Two 4 MB regions with a 4 MB hole between them so that the
+     tests exercise the sparse object descriptor table.  */
+#define SIZE 4 * 1024 * 1024
+  void *m = mmap (NULL, 3 * SIZE, PROT_READ | PROT_WRITE,
 		  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
   if (m == MAP_FAILED)
     panic ("No memory: %m");
   assert_perror (errno);
+  munmap (m + SIZE, SIZE);
   add ((l4_word_t) m, SIZE);
+  add ((l4_word_t) m + 2 * SIZE, SIZE);
 
 #else
   l4_word_t s;
@@ -358,6 +416,20 @@ memory_frame_allocate (struct activity *activity)
   pager_query ();
 
   uintptr_t f = zalloc (PAGESIZE);
+  if (! f && superpage_release (1))
+    /* Some frames were held back for superpages.  */
+    f = zalloc (PAGESIZE);
+
+  if (! f && ! available_list_count (&available))
+    /* We are completely out of frames: the pager thread did not keep
+       up.  Collect synchronously.  */
+    pager_collect (PAGER_HIGH_WATER_MARK);
+
+  if (! f && ! available_list_count (&available))
+    /* Try to make some dirty pages available by writing them to
+       backing store.  */
+    backing_store_launder (VG_FOLIO_OBJECTS);
+
   if (! f)
     {
       /* Check if there are any pages on the available list.  */
@@ -367,8 +439,21 @@ memory_frame_allocate (struct activity *activity)
       struct object_desc *desc = available_list_head (&available);
       while (desc)
 	{
-	  if (desc->type != vg_cap_activity_control
-	      && desc->type != vg_cap_thread)
+	  bool special = (desc->type == vg_cap_activity_control
+			  || desc->type == vg_cap_thread);
+	  if (desc->type == vg_cap_messenger)
+	    /* The futex hash and the timer wheel hold pointers to
+	       messengers waiting on futexes and to messengers with
+	       timed waits.  */
+	    {
+	      struct messenger *m
+		= (struct messenger *) object_desc_to_object (desc);
+	      special = m->wait_queue_p
+		&& (m->wait_reason == MESSENGER_WAIT_FUTEX
+		    || timer_pending (&m->timeout));
+	    }
+
+	  if (! special)
 	    /* We will detach DESC from AVAILALBE in
 	       memory_object_destroy.  */
 	    break;
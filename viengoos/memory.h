@@ -47,6 +47,24 @@ extern l4_word_t first_frame;
 /* Address of the first byte of the last frame.  */
 extern l4_word_t last_frame;
 
+/* A region of physical memory.  START is the address of the first
+   byte and END the address of the last byte.  */
+struct memory_region
+{
+  l4_word_t start;
+  l4_word_t end;
+};
+
+/* The maximum number of regions memory_grab records.  If the memory
+   map is more fragmented, the closest regions are merged, i.e., the
+   holes between them are treated as memory.  */
+#define MEMORY_REGIONS_MAX 32
+
+/* The regions of physical memory that memory_grab found.  They are
+   not sorted.  */
+extern struct memory_region memory_regions[MEMORY_REGIONS_MAX];
+extern int memory_regions_count;
+
 /* Reserve the memory starting at byte START and ending at byte END
    with the reservation RESERVATION.  The memory is added to the free
    pool if and when the reservation expires.  Returns true on success.
@@ -19,6 +19,7 @@
    <http://www.gnu.org/licenses/>.  */
 
 #include <stdbool.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 #include <viengoos/cap.h>
@@ -27,11 +28,40 @@
 #include "messenger.h"
 #include "object.h"
 #include "thread.h"
+#include "activity.h"
 
 /* When the kernel formulates relies, it does so in this buffer.  */
 static char reply_message_data[PAGESIZE] __attribute__ ((aligned (PAGESIZE)));
 struct vg_message *reply_buffer = (struct vg_message *) &reply_message_data[0];
 
+/* The maximum number of capabilities returned by a method.  */
+#define REPLY_BUFFER_CAPS 4
+static struct vg_cap reply_buffer_caps[REPLY_BUFFER_CAPS];
+
+void
+reply_buffer_pin (void)
+{
+  vg_addr_t *addrs = vg_message_caps (reply_buffer);
+
+  int i;
+  for (i = 0; i < vg_message_cap_count (reply_buffer); i ++)
+    {
+      struct vg_cap *cap = (struct vg_cap *) (uintptr_t) addrs[i].raw;
+      if (! cap || i >= REPLY_BUFFER_CAPS)
+	{
+	  addrs[i].raw = 0;
+	  continue;
+	}
+
+      reply_buffer_caps[i] = *cap;
+      addrs[i].raw = (uintptr_t) &reply_buffer_caps[i];
+    }
+}
+
+/* The maximum number of overwritten capabilities that
+   messenger_load_internal collects before shooting them down.  */
+#define MESSENGER_SHOOTDOWN_BATCH 16
+
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
@@ -192,7 +222,73 @@ messenger_load_internal (struct activity *activity,
 	}
     }
 
-  /* Copy the caps.  */
+  /* Copy the caps.
+
+     A message's capabilities are usually stored in consecutive slots
+     of the same capability page (as are the slots that receive them).
+     We cache the last capability page indexed in each address space
+     so that such slots are found without walking the address space.
+
+     Shooting down the mappings derived from an overwritten capability
+     is deferred: the overwritten capabilities are collected and shot
+     down in batches, skipping duplicates.  This is done before the
+     message is delivered.  */
+  struct as_lookup_cache tcache;
+  struct as_lookup_cache scache;
+  as_lookup_cache_flush (&tcache);
+  as_lookup_cache_flush (&scache);
+
+  struct vg_cap shootdowns[MESSENGER_SHOOTDOWN_BATCH];
+  int shootdown_count = 0;
+
+  void shootdown_flush (void)
+  {
+    int j;
+    for (j = 0; j < shootdown_count; j ++)
+      cap_shootdown (activity, &shootdowns[j]);
+    shootdown_count = 0;
+  }
+
+  void shootdown_add (struct vg_cap *cap)
+  {
+    if (cap->type == vg_cap_void)
+      return;
+
+    /* cap_shootdown depends on the designated object, the policy
+       with which it is looked up and how the capability translates
+       addresses: its guard and, for a cappage, its subpage.  */
+    int j;
+    for (j = 0; j < shootdown_count; j ++)
+      if (shootdowns[j].type == cap->type
+	  && shootdowns[j].oid == cap->oid
+	  && shootdowns[j].version == cap->version
+	  && shootdowns[j].discardable == cap->discardable
+	  && shootdowns[j].priority == cap->priority
+	  && shootdowns[j].addr_trans.raw == cap->addr_trans.raw)
+	return;
+
+    if (shootdown_count == MESSENGER_SHOOTDOWN_BATCH)
+      shootdown_flush ();
+    shootdowns[shootdown_count ++] = *cap;
+  }
+
+  /* Whether changing a slot that holds a capability of type TYPE may
+     change how other addresses are translated.  */
+  bool translates (enum vg_cap_type type)
+  {
+    switch (type)
+      {
+      case vg_cap_cappage:
+      case vg_cap_rcappage:
+      case vg_cap_folio:
+      case vg_cap_thread:
+      case vg_cap_messenger:
+	return true;
+      default:
+	return false;
+      }
+  }
+
   int i;
   for (i = 0; i < MIN (saddr_count, taddr_count); i ++)
     {
@@ -202,11 +298,11 @@ messenger_load_internal (struct activity *activity,
       struct vg_cap *tcap = NULL;
       if (! VG_ADDR_IS_VOID (taddrs[i]))
 	{
-	  as_slot_lookup_rel_use (activity, &target->as_root, taddrs[i],
-				  ({
-				    twritable = writable;
-				    tcap = slot;
-				  }));
+	  union as_lookup_ret ret;
+	  if (as_lookup_rel_cached (activity, &target->as_root, taddrs[i],
+				    -1, &twritable, as_lookup_want_slot,
+				    &ret, &tcache))
+	    tcap = ret.capp;
 	  if (! tcap || ! twritable)
 	    debug (0, DEBUG_BOLD ("Target " VG_ADDR_FMT " does not designate "
 				  "a %svalid slot!"),
@@ -221,10 +317,12 @@ messenger_load_internal (struct activity *activity,
 	  bool swritable = true;
 	  if (source)
 	    {
-	      if (! VG_ADDR_IS_VOID (saddrs[i]))
-		scap = as_cap_lookup_rel (activity,
-					  &source->as_root, saddrs[i],
-					  -1, &swritable);
+	      union as_lookup_ret ret;
+	      if (! VG_ADDR_IS_VOID (saddrs[i])
+		  && as_lookup_rel_cached (activity, &source->as_root,
+					   saddrs[i], -1, &swritable,
+					   as_lookup_want_cap, &ret, &scache))
+		scap = ret.cap;
 	    }
 	  else
 	    /* This is a kernel provided buffer.  In this case the
@@ -235,8 +333,16 @@ messenger_load_internal (struct activity *activity,
 	  if (! swritable)
 	    scap.type = vg_cap_type_weaken (scap.type);
 
+	  if (translates (tcap->type) || translates (scap.type))
+	    /* The translation of the cached capability pages may
+	       change.  */
+	    {
+	      as_lookup_cache_flush (&tcache);
+	      as_lookup_cache_flush (&scache);
+	    }
+
 	  /* Shoot down the capability.  */
-	  cap_shootdown (activity, tcap);
+	  shootdown_add (tcap);
 
 	  /* Preserve the address translator and policy.  */
 	  struct vg_cap_properties props = VG_CAP_PROPERTIES_GET (*tcap);
@@ -249,6 +355,8 @@ messenger_load_internal (struct activity *activity,
       else
 	taddrs[i] = VG_ADDR_VOID;
     }
+  shootdown_flush ();
+
   if (i < MAX (taddr_count, saddr_count) && target->out_of_band && taddrs)
     /* Set the address of any non-transferred caps in the target to
        VG_ADDR_VOID.  */
@@ -268,7 +376,7 @@ messenger_load_internal (struct activity *activity,
   if (target->activate_on_receive)
     messenger_message_deliver (activity, target);
   else
-    debug (0, "Not activing target.");
+    debug (5, "Not activing target.");
 
   if (source && source->activate_on_send)
     messenger_message_deliver (activity, source);
@@ -345,3 +453,24 @@ messenger_destroy (struct activity *activity, struct messenger *messenger)
     /* MESSENGER is attached to a wait queue.  Detach it.  */
     object_wait_queue_unlink (activity, messenger);
 }
+
+static void
+messenger_timeout_expire (struct timer *timer)
+{
+  struct messenger *messenger
+    = (void *) timer - offsetof (struct messenger, timeout);
+  assert (messenger->wait_queue_p);
+
+  debug (5, "Wait (reason: %d) timed out", messenger->wait_reason);
+
+  object_wait_queue_unlink (root_activity, messenger);
+  rpc_error_reply (root_activity, messenger, ETIMEDOUT);
+}
+
+void
+messenger_timeout (struct messenger *messenger, uint64_t deadline)
+{
+  assert (messenger->wait_queue_p);
+
+  timer_add (&messenger->timeout, deadline, messenger_timeout_expire);
+}
@@ -28,9 +28,8 @@
 #include <viengoos/messenger.h>
 #include <viengoos/message.h>
 
-#ifndef NDEBUG
 #include "../viengoos/list.h"
-#endif
+#include "../viengoos/timer.h"
 
 /* Messenger may be enqueued on any object and for different reasons.
    The reason an object is enqueued is stored in the WAIT_REASON.
@@ -166,12 +165,24 @@ struct messenger
   uint32_t wait_reason_arg;
   uint32_t wait_reason_arg2;
 
+  /* If the messenger is on a wait queue and the wait is timed, the
+     timer that ends the wait (see messenger_timeout).  */
+  struct timer timeout;
+
+  /* If WAIT_REASON is MESSENGER_WAIT_FUTEX, the OID of the object on
+     which the messenger is waiting and the node in the futex hash
+     bucket.  See futex.h.  */
+  vg_oid_t futex_oid;
+  struct list_node futex_node;
+
 #ifndef NDEBUG
   /* Used for debugging futexes.  */
   struct list_node futex_waiter_node;
 #endif
 };
 
+LIST_CLASS(futex_bucket, struct messenger, futex_node, true)
+
 #ifndef NDEBUG
 LIST_CLASS(futex_waiter, struct messenger, futex_waiter_node, true)
 /* List of threads waiting on a futex.  */
@@ -207,6 +218,13 @@ extern bool messenger_message_deliver (struct activity *activity,
 extern void messenger_unblock (struct activity *activity,
 			       struct messenger *messenger);
 
+/* MESSENGER, which is on a wait queue, stops waiting at DEADLINE (in
+   the units of l4_system_clock): it is then removed from the wait
+   queue and sent ETIMEDOUT.  The timeout is cancelled when MESSENGER
+   is removed from the wait queue.  */
+extern void messenger_timeout (struct messenger *messenger,
+			       uint64_t deadline);
+
 /* Destroy the messenger MESSENGER: it is about to be deallocated.  */
 extern void messenger_destroy (struct activity *activity,
 			       struct messenger *messenger);
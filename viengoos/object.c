@@ -33,11 +33,19 @@
 #include "thread.h"
 #include "zalloc.h"
 #include "messenger.h"
+#include "backing-store.h"
+#include "superpage.h"
+#include "futex.h"
 
 /* For lack of a better place.  */
 ss_mutex_t kernel_lock;
 
 struct object_desc *object_descs;
+int object_descs_count;
+int *object_desc_section_index;
+int *object_desc_sections;
+unsigned char *object_descs_aged;
+int object_descs_aged_size;
 
 struct laundry_list laundry;
 struct available_list available;
@@ -70,13 +78,56 @@ object_init (void)
   build_assert ((sizeof (struct vg_cap) & (sizeof (struct vg_cap) - 1)) == 0);
 
 
+  /* Find the sections that contain memory.  */
+  int sections = ((last_frame - first_frame) / PAGESIZE
+		  >> OBJECT_DESC_SECTION_FRAMES_LOG2) + 1;
+
+  size_t size = (sections * sizeof (int) + PAGESIZE - 1) & ~(PAGESIZE - 1);
+  object_desc_section_index = (void *) zalloc (size);
+  object_desc_sections = (void *) zalloc (size);
+  if (! object_desc_section_index || ! object_desc_sections)
+    panic ("Failed to allocate memory for object descriptor sections!\n");
+
+  int i;
+  for (i = 0; i < sections; i ++)
+    object_desc_section_index[i] = -1;
+
+  for (i = 0; i < memory_regions_count; i ++)
+    {
+      int first = (memory_regions[i].start - first_frame) / PAGESIZE
+	>> OBJECT_DESC_SECTION_FRAMES_LOG2;
+      int last = (memory_regions[i].end - first_frame) / PAGESIZE
+	>> OBJECT_DESC_SECTION_FRAMES_LOG2;
+      int s;
+      for (s = first; s <= last; s ++)
+	object_desc_section_index[s] = 0;
+    }
+
+  int populated = 0;
+  for (i = 0; i < sections; i ++)
+    if (object_desc_section_index[i] == 0)
+      {
+	object_desc_section_index[i] = populated;
+	object_desc_sections[populated] = i;
+	populated ++;
+      }
+
+  object_descs_count = populated * OBJECT_DESC_SECTION_FRAMES;
+
+  printf ("object descriptors: %d of %d sections populated, "
+	  "%d kb saved\n",
+	  populated, sections,
+	  (int) ((sections - populated) * OBJECT_DESC_SECTION_FRAMES
+		 * sizeof (struct object_desc) / 1024));
+
+
   /* Allocate object hash.  */
-  int count = (last_frame - first_frame) / PAGESIZE + 1;
+  int count = object_descs_count;
 
   /* XXX: Use a load factory of just 30% until we get a better hash
      implementation.  The default of 80% can result in very long
      chains.  */
-  size_t size = hurd_ihash_buffer_size (count, true, 30);
+  size = hurd_ihash_buffer_size (count, true, 30);
   /* Round up to a multiple of the page size.  */
   size = (size + PAGESIZE - 1) & ~(PAGESIZE - 1);
 
@@ -90,24 +141,32 @@ object_init (void)
 
 
   /* Allocate object desc array: enough object descriptors for the
-     number of pages.  */
-  size = ((last_frame - first_frame) / PAGESIZE + 1)
-    * sizeof (struct object_desc);
+     populated sections.  */
+  size = object_descs_count * sizeof (struct object_desc);
   /* Round up.  */
   size = (size + PAGESIZE - 1) & ~(PAGESIZE - 1);
 
   object_descs = (void *) zalloc (size);
   if (! object_descs)
     panic ("Failed to allocate memory for object descriptor array!\n");
+
+  object_descs_aged_size = (object_descs_count + 7) / 8;
+  size = (object_descs_aged_size + PAGESIZE - 1) & ~(PAGESIZE - 1);
+
+  object_descs_aged = (void *) zalloc (size);
+  if (! object_descs_aged)
+    panic ("Failed to allocate memory for the ager's bitmap!\n");
 }
 
 /* Allocate and set up a memory object.  TYPE, OID and VERSION must
-   correspond to the values storage on disk.  */
+   correspond to the values storage on disk.  CONTENT is true if the
+   caller will read the object's content from backing store,
+   otherwise, the object is a zero page.  */
 static struct vg_object *
 memory_object_alloc (struct activity *activity,
 		     enum vg_cap_type type,
 		     vg_oid_t oid, l4_word_t version,
-		     struct vg_object_policy policy)
+		     struct vg_object_policy policy, bool content)
 {
   debug (5, "Allocating %llx(%d), %s", oid, version, vg_cap_type_string (type));
 
@@ -115,7 +174,11 @@ memory_object_alloc (struct activity *activity,
   assert (type != vg_cap_void);
   assert ((type == vg_cap_folio) == ((oid % (VG_FOLIO_OBJECTS + 1)) == 0));
 
-  struct vg_object *object = (struct vg_object *) memory_frame_allocate (activity);
+  struct vg_object *object
+    = (struct vg_object *) superpage_frame (activity, oid, type, content);
+  bool reserved = object != NULL;
+  if (! object)
+    object = (struct vg_object *) memory_frame_allocate (activity);
   if (! object)
     {
       /* XXX: Do some garbage collection.  */
@@ -148,6 +211,7 @@ memory_object_alloc (struct activity *activity,
 
   /* Mark the object as live.  */
   odesc->live = 1;
+  object_desc_aged_update (odesc);
 
   if (! activity)
     /* This may only happen if we are initializing.  */
@@ -156,6 +220,10 @@ memory_object_alloc (struct activity *activity,
     /* Account the memory to the activity ACTIVITY.  */
     object_desc_claim (activity, odesc, policy, true);
 
+  /* Only now: object_desc_claim would consider the first claim a
+     divergence.  */
+  odesc->superpage = reserved;
+
   return object;
 }
 
@@ -194,6 +262,7 @@ memory_object_destroy (struct activity *activity, struct vg_object *object)
     }
 
   desc->live = 0;
+  object_desc_aged_update (desc);
 
   hurd_ihash_locp_remove (&objects, desc->locp);
   assert (! hurd_ihash_find (&objects, desc->oid));
@@ -278,7 +347,7 @@ object_find (struct activity *activity, vg_oid_t oid,
 	  assert (bit_test (folios, oid / (VG_FOLIO_OBJECTS + 1)));
 
 	  return memory_object_alloc (activity, vg_cap_folio, oid, 0,
-				      policy);
+				      policy, false);
 	}
 
       /* It's not an in-memory folio.  We read it from disk below.  */
@@ -305,13 +374,39 @@ object_find (struct activity *activity, vg_oid_t oid,
 	   backing store: just allocate a page and zero it.  */
 	return memory_object_alloc (activity, vg_folio_object_type (folio, page),
 				    oid, folio_object_version (folio, page),
-				    policy);
+				    policy, false);
     }
-  
+
+  if (page == -1)
+    /* XXX: Folios are currently always in core.  */
+    return NULL;
+
   /* Read the object from backing store.  */
+  struct vg_object *object
+    = memory_object_alloc (activity, vg_folio_object_type (folio, page),
+			   oid, folio_object_version (folio, page), policy,
+			   true);
+  if (! object)
+    return NULL;
+
+  /* Allocating a frame may have caused the folio to move.  */
+  folio = objects_folio (activity, object);
+
+  error_t err = backing_store_read (folio, page, object);
+  if (err)
+    {
+      memory_object_destroy (activity, object);
+      memory_frame_free ((l4_word_t) object);
+      return NULL;
+    }
+
+#ifndef _L4_TEST_ENVIRONMENT
+  /* Reading the object set the status bits.  Clear them: the
+     object's content matches that on backing store.  */
+  l4_flush (l4_fpage ((l4_word_t) object, PAGESIZE));
+#endif
 
-  /* XXX: Do it.  */
-  return NULL;
+  return object;
 }
 
 void
@@ -665,6 +760,33 @@ folio_object_alloc (struct activity *activity,
   return vg_cap;
 }
 
+void
+folio_object_alloc_range (struct activity *activity,
+			  struct vg_folio *folio, int idx, int count,
+			  enum vg_cap_type type,
+			  struct vg_object_policy policy,
+			  uintptr_t return_code,
+			  struct vg_cap **slots)
+{
+  assert (0 <= idx && 0 < count && idx + count <= VG_FOLIO_OBJECTS);
+
+  int i;
+  for (i = 0; i < count; i ++)
+    {
+      struct vg_cap cap = folio_object_alloc (activity, folio, idx + i,
+					      type, policy, return_code);
+      if (! slots)
+	continue;
+
+      cap_shootdown (activity, slots[i]);
+
+      /* Preserve the address translator and policy.  */
+      struct vg_cap_properties props = VG_CAP_PROPERTIES_GET (*slots[i]);
+      *slots[i] = cap;
+      VG_CAP_PROPERTIES_SET (slots[i], props);
+    }
+}
+
 void
 folio_policy (struct activity *activity,
 	      struct vg_folio *folio,
@@ -703,6 +825,17 @@ object_desc_claim (struct activity *activity, struct object_desc *desc,
   struct vg_object_policy o = desc->policy;
   bool ec = desc->eviction_candidate;
 
+  /* The object may be modified: any write to backing store that is
+     in flight no longer reflects its content.  */
+  desc->laundering = false;
+
+  if (desc->superpage
+      && (activity != desc->activity
+	  || policy.priority != o.priority
+	  || policy.discardable != o.discardable))
+    /* DESC no longer looks like the rest of its superpage.  */
+    superpage_diverge (desc);
+
 #ifndef NDEBUG
   if (desc->activity && update_accounting)
     {
@@ -902,6 +1035,7 @@ object_desc_claim (struct activity *activity, struct object_desc *desc,
     }
 
   desc->eviction_candidate = false;
+  object_desc_aged_update (desc);
   desc->activity = activity;
   desc->policy.discardable = policy.discardable;
 
@@ -1335,10 +1469,15 @@ object_wait_queue_unlink (struct activity *activity,
 
   messenger->wait_queue_p = false;
 
-#ifndef NDEBUG
+  timer_cancel (&messenger->timeout);
+
   if (messenger->wait_reason == MESSENGER_WAIT_FUTEX)
-    futex_waiter_list_unlink (&futex_waiters, messenger);
+    {
+      futex_unlink (messenger);
+#ifndef NDEBUG
+      futex_waiter_list_unlink (&futex_waiters, messenger);
 #endif
+    }
 
   object_wait_queue_check (activity, messenger);
 }
@@ -32,6 +32,7 @@
 #include <viengoos/folio.h>
 #include <hurd/btree.h>
 #include <stdint.h>
+#include <bit-array.h>
 
 #include "mutex.h"
 #include "cap.h"
@@ -139,6 +140,14 @@ struct object_desc
 
   /* Whether the object has been selected for eviction.  */
   uintptr_t eviction_candidate : 1;
+  /* Whether the object is being written to backing store.  Cleared
+     when the object is claimed: the write is then stale.  The object
+     is not written again until the stale write has been committed
+     (see backing-store.c).  */
+  uintptr_t laundering : 1;
+  /* Whether the object's frame is part of a superpage reservation
+     (see superpage.h).  */
+  uintptr_t superpage : 1;
 
   /* Whether the object has been mapped to a process.  */
   uintptr_t mapped : 1;
@@ -208,11 +217,45 @@ struct object_desc
   };
 };
 
-/* We keep an array of object descriptors.  There is a linear mapping
-   between object desciptors and physical memory addresses.  XXX: This
-   is cheap but problematic if there are large holes in the physical
-   memory map.  */
+/* We keep an array of object descriptors, one per frame.  To avoid
+   wasting descriptors on holes in the physical memory map, physical
+   memory is divided into sections of OBJECT_DESC_SECTION_FRAMES
+   frames starting at FIRST_FRAME, and descriptors are only allocated
+   for the sections that contain some memory.  These are stored back
+   to back in OBJECT_DESCS.  Translating between a frame and its
+   descriptor takes one table lookup in either direction.  */
+#define OBJECT_DESC_SECTION_FRAMES_LOG2 10
+#define OBJECT_DESC_SECTION_FRAMES (1 << OBJECT_DESC_SECTION_FRAMES_LOG2)
+
 extern struct object_desc *object_descs;
+/* The number of elements in OBJECT_DESCS.  */
+extern int object_descs_count;
+
+/* Indexed by the number of a section of physical memory.  The
+   position of the section's descriptors in OBJECT_DESCS (in units of
+   sections) or -1 if the section contains no memory.  */
+extern int *object_desc_section_index;
+/* Indexed by the position of a section's descriptors in OBJECT_DESCS
+   (in units of sections).  The section's number.  */
+extern int *object_desc_sections;
+
+/* A bitmap with one bit per element of OBJECT_DESCS.  A bit is set if
+   the descriptor is live and not an eviction candidate, i.e., if the
+   ager needs to examine it.  This allows the ager to skip free frames
+   and eviction candidates a byte at a time.  */
+extern unsigned char *object_descs_aged;
+/* The size of OBJECT_DESCS_AGED in bytes.  */
+extern int object_descs_aged_size;
+
+/* Update DESC's bit in OBJECT_DESCS_AGED.  Must be called whenever
+   DESC->LIVE or DESC->EVICTION_CANDIDATE changes.  */
+static inline void
+object_desc_aged_update (struct object_desc *desc)
+{
+  bit_set_to (object_descs_aged, object_descs_aged_size,
+	      desc - object_descs,
+	      desc->live && ! desc->eviction_candidate);
+}
 
 /* This does not really belong here but there isn't really a better
    place.  The first reason is that it relies on the definition of
@@ -305,17 +348,19 @@ extern void memory_object_destroy (struct activity *activity,
 #define object_desc_to_object(desc_)					\
   ({									\
     struct object_desc *desc__ = (desc_);				\
+    int i__ = (desc__) - object_descs;					\
     /* There is only one legal area for descriptors.  */		\
-    assertx ((uintptr_t) object_descs <= (uintptr_t) (desc__),		\
-	     "%x > %x",							\
-	     (uintptr_t) object_descs, (uintptr_t) (desc__));		\
-    assert ((uintptr_t) (desc__)					\
-	    <= (uintptr_t) &object_descs[(last_frame - first_frame)	\
-					 / PAGESIZE]);			\
+    assertx (0 <= i__ && i__ < object_descs_count,			\
+	     "%x not in %x+%d",						\
+	     (uintptr_t) (desc__), (uintptr_t) object_descs,		\
+	     object_descs_count);					\
 									\
-    (struct vg_object *) (first_frame					\
-		       + (((uintptr_t) (desc__) - (uintptr_t) object_descs) \
-			  / sizeof (struct object_desc)) * PAGESIZE);	\
+    uintptr_t frame__							\
+      = ((uintptr_t) object_desc_sections[i__				\
+					  >> OBJECT_DESC_SECTION_FRAMES_LOG2] \
+	 << OBJECT_DESC_SECTION_FRAMES_LOG2)				\
+      + (i__ & (OBJECT_DESC_SECTION_FRAMES - 1));			\
+    (struct vg_object *) (first_frame + frame__ * PAGESIZE);		\
   })
 
 /* Return the object descriptor corresponding to the object
@@ -329,7 +374,14 @@ extern void memory_object_destroy (struct activity *activity,
     assert (first_frame <= (uintptr_t) (object__));			\
     assert ((uintptr_t) (object__) <= last_frame);			\
 									\
-    &object_descs[((uintptr_t) (object__) - first_frame) / PAGESIZE];	\
+    uintptr_t frame__ = ((uintptr_t) (object__) - first_frame) / PAGESIZE; \
+    int section__							\
+      = object_desc_section_index[frame__				\
+				  >> OBJECT_DESC_SECTION_FRAMES_LOG2];	\
+    assert (section__ >= 0);						\
+									\
+    &object_descs[(section__ << OBJECT_DESC_SECTION_FRAMES_LOG2)	\
+		  + (frame__ & (OBJECT_DESC_SECTION_FRAMES - 1))];	\
   })
 
 /* Return a vg_cap referencing the object designated by OBJECT_DESC.  */
@@ -372,12 +424,23 @@ object_type (struct vg_object *object)
   return object_to_object_desc (object)->type;
 }
 
+#ifdef SUPERPAGES
+/* See superpage.h.  */
+extern void superpage_unmap (struct object_desc *desc);
+#endif
+
 /* Unmaps the object corresponding to DESC from all clients.  */
 static inline void
 object_desc_unmap (struct object_desc *desc)
 {
   assert (desc->live);
 
+#ifdef SUPERPAGES
+  if (desc->mapped && desc->superpage)
+    /* The object may be mapped as part of a superpage.  */
+    superpage_unmap (desc);
+#endif
+
   if (desc->mapped)
     {
 #ifdef USE_L4
@@ -430,6 +493,91 @@ object_desc_flush (struct object_desc *desc, bool clear_kernel)
     }
 }
 
+/* Equivalent to calling object_desc_flush (DESCS[I], false) for each
+   of the COUNT descriptors, but uses a single l4_unmap_fpages and a
+   single l4_flush_fpages.  COUNT may be at most L4_NUM_MRS.  */
+static inline void
+object_descs_flush (struct object_desc *descs[], int count)
+{
+  int i;
+
+#ifdef USE_L4
+# ifndef _L4_TEST_ENVIRONMENT
+  l4_fpage_t fpages[count];
+  int n;
+
+#ifdef SUPERPAGES
+  for (i = 0; i < count; i ++)
+    if (descs[i]->mapped && descs[i]->superpage)
+      /* The object may be mapped as part of a superpage.  */
+      superpage_unmap (descs[i]);
+#endif
+
+  /* First, unmap the objects that are mapped from all clients.  */
+  n = 0;
+  for (i = 0; i < count; i ++)
+    if (descs[i]->mapped)
+      fpages[n ++]
+	= l4_fpage_add_rights (l4_fpage ((l4_word_t)
+					 object_desc_to_object (descs[i]),
+					 PAGESIZE),
+			       L4_FPAGE_FULLY_ACCESSIBLE);
+
+  if (n > 0)
+    {
+      l4_unmap_fpages (n, fpages);
+
+      n = 0;
+      for (i = 0; i < count; i ++)
+	if (descs[i]->mapped)
+	  {
+	    l4_fpage_t result = fpages[n ++];
+
+	    descs[i]->dirty |= !!l4_was_written (result);
+	    descs[i]->user_referenced |= !!l4_was_referenced (result);
+	    descs[i]->user_dirty |= !!l4_was_written (result);
+	  }
+    }
+# endif
+#else
+# warning Unimplemened on this platform.
+#endif
+
+  for (i = 0; i < count; i ++)
+    {
+      assert (descs[i]->live);
+      descs[i]->mapped = false;
+    }
+
+#ifdef USE_L4
+# ifndef _L4_TEST_ENVIRONMENT
+  /* Then get the status bits for this address space for those
+     objects for which they might still make a difference.  */
+  n = 0;
+  for (i = 0; i < count; i ++)
+    if (! descs[i]->dirty || ! descs[i]->user_referenced)
+      fpages[n ++] = l4_fpage ((l4_word_t) object_desc_to_object (descs[i]),
+			       PAGESIZE);
+
+  if (n > 0)
+    {
+      l4_flush_fpages (n, fpages);
+
+      n = 0;
+      for (i = 0; i < count; i ++)
+	if (! descs[i]->dirty || ! descs[i]->user_referenced)
+	  {
+	    l4_fpage_t result = fpages[n ++];
+
+	    descs[i]->dirty |= !!l4_was_written (result);
+	    descs[i]->user_referenced |= !!l4_was_referenced (result);
+	    descs[i]->user_dirty |= !!l4_was_written (result);
+	  }
+    }
+# endif
+#endif
+}
+
 /* Transfer ownership of DESC to the activity ACTIVITY.  If ACTIVITY
    is NULL, detaches DESC from lists (this functionality should only
    be used by memory_object_destroy).  If UPDATE_ACCOUNTING is not
@@ -490,6 +638,19 @@ extern struct vg_cap folio_object_alloc (struct activity *activity,
 					 struct vg_object_policy policy,
 					 uintptr_t return_code);
 
+/* Allocate objects IDX through IDX + COUNT - 1 of folio FOLIO as if
+   by calling folio_object_alloc on each.  If SLOTS is not NULL, store
+   a capability to the Ith object in *SLOTS[I], preserving the slot's
+   address translator and policy.  The slots must not lie in the
+   objects being allocated.  */
+extern void folio_object_alloc_range (struct activity *activity,
+				      struct vg_folio *folio,
+				      int idx, int count,
+				      enum vg_cap_type type,
+				      struct vg_object_policy policy,
+				      uintptr_t return_code,
+				      struct vg_cap **slots);
+
 /* Deallocate the object stored in page PAGE of folio FOLIO.  */
 static inline void
 folio_object_free (struct activity *activity,
@@ -18,14 +18,25 @@
    along with this program.  If not, see
    <http://www.gnu.org/licenses/>.  */
 
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <l4/ipc.h>
+#include <atomic.h>
+
+#include "viengoos.h"
+#include "mutex.h"
 #include "memory.h"
 #include "zalloc.h"
 #include "activity.h"
 #include "object.h"
 #include "pager.h"
+#include "replacement.h"
 #include "profile.h"
 #include "messenger.h"
 #include "thread.h"
+#include "timer.h"
 
 int pager_min_alloc_before_next_collect;
 
@@ -42,7 +53,11 @@ is_clean (struct object_desc *desc)
 	   l4_was_written (result) ? "dirty" : "",
 	   l4_was_referenced (result) ? "refed" : "");
 
-  if (! desc->dirty)
+  if (! desc->dirty
+      && ! folio_object_content (objects_folio (desc->activity, object),
+				 objects_folio_offset (object)))
+    /* The object is clean and has no content on backing store: it
+       must be a zero page.  */
     {
       uint64_t *p = (uint64_t *) object;
       uint64_t i;
@@ -62,6 +77,10 @@ is_clean (struct object_desc *desc)
 #endif
 }
 
+/* The maximum number of objects that reclaim_from flushes at once.
+   Like the ager, we use at most half of the message registers.  */
+#define RECLAIM_BATCH (L4_NUM_MRS / 2)
+
 /* Reclaim GOAL pages from VICTIM.  (Reclaim means either schedule for
    page-out if dirty and not discardable or place on the clean
    list.)  */
@@ -72,7 +91,51 @@ reclaim_from (struct activity *victim, int goal)
   int laundry_count = 0;
   int discarded = 0;
 
-  /* XXX: Implement group dealloc.  */
+  /* Victims are flushed and moved to the eviction lists in batches
+     of up to RECLAIM_BATCH objects.  The accounting is updated once
+     at the end.  */
+  struct object_desc *batch[RECLAIM_BATCH];
+  int batch_count = 0;
+
+  void batch_flush (void)
+  {
+    if (batch_count == 0)
+      return;
+
+    object_descs_flush (batch, batch_count);
+
+    int j;
+    for (j = 0; j < batch_count; j ++)
+      {
+	struct object_desc *desc = batch[j];
+
+	desc->eviction_candidate = true;
+	object_desc_aged_update (desc);
+
+	if (desc->dirty && ! desc->policy.discardable)
+	  {
+	    if (! list_node_attached (&desc->laundry_node))
+	      laundry_list_enqueue (&laundry, desc);
+
+	    eviction_list_enqueue (&victim->eviction_dirty, desc);
+	    laundry_count ++;
+	  }
+	else
+	  {
+	    assert (! list_node_attached (&desc->available_node));
+	    is_clean (desc);
+
+	    available_list_enqueue (&available, desc);
+	    eviction_list_enqueue (&victim->eviction_clean, desc);
+
+	    if (desc->policy.discardable)
+	      discarded ++;
+	  }
+      }
+
+    count += batch_count;
+    batch_count = 0;
+  }
 
   int i;
 #ifndef NDEBUG
@@ -103,7 +166,7 @@ reclaim_from (struct activity *victim, int goal)
       int s = count;
 
       struct object_desc *desc;
-      while (count < goal
+      while (count + batch_count < goal
 	     && (desc = activity_list_dequeue (&victim->frames[i].inactive)))
 	{
 	  assert (! desc->eviction_candidate);
@@ -112,71 +175,32 @@ reclaim_from (struct activity *victim, int goal)
 		   "%d != %d",
 		   i, desc->policy.priority);
 
-	  object_desc_flush (desc, false);
-	  if (desc->dirty && ! desc->policy.discardable)
-	    {
-	      eviction_list_enqueue (&victim->eviction_dirty, desc);
-
-	      laundry_list_enqueue (&laundry, desc);
-	      laundry_count ++;
-	    }
-	  else
-	    {
-	      is_clean (desc);
-
-	      available_list_enqueue (&available, desc);
-	      eviction_list_enqueue (&victim->eviction_clean, desc);
-
-	      if (desc->policy.discardable)
-		discarded ++;
-	    }
-
-	  desc->eviction_candidate = true;
-
-	  count ++;
+	  batch[batch_count ++] = desc;
+	  if (batch_count == RECLAIM_BATCH)
+	    batch_flush ();
 	}
+      batch_flush ();
 
       if (count - s > 0)
 	debug (5, "Reclaimed %d inactive, priority level %d",
 	       count - s, i);
       s = count;
 
-      /* Currently we evict in LIFO order.  We should do a semi-sort and
-	 then evict accordingly.  */
-      while (count < goal
-	     && (desc = activity_list_dequeue (&victim->frames[i].active)))
+      /* Which active object goes next is up to the replacement
+	 policy.  */
+      while (count + batch_count < goal
+	     && (desc = replacement_select (&victim->frames[i].active)))
 	{
 	  assert (! desc->eviction_candidate);
 	  assertx (i == desc->policy.priority,
 		   "%d != %d",
 		   i, desc->policy.priority);
 
-	  object_desc_flush (desc, false);
-
-	  desc->eviction_candidate = true;
-
-	  if (desc->dirty && ! desc->policy.discardable)
-	    {
-	      if (! list_node_attached (&desc->laundry_node))
-		laundry_list_enqueue (&laundry, desc);
-
-	      eviction_list_enqueue (&victim->eviction_dirty, desc);
-	      laundry_count ++;
-	    }
-	  else
-	    {
-	      assert (! list_node_attached (&desc->available_node));
-	      is_clean (desc);
-
-	      available_list_enqueue (&available, desc);
-	      eviction_list_enqueue (&victim->eviction_clean, desc);
-
-	      if (desc->policy.discardable)
-		discarded ++;
-	    }
-
-	  count ++;
+	  batch[batch_count ++] = desc;
+	  if (batch_count == RECLAIM_BATCH)
+	    batch_flush ();
 	}
+      batch_flush ();
 
       if (count - s > 0)
 	debug (5, "Reclaimed %d active, priority level %d",
@@ -558,3 +582,74 @@ pager_collect (int goal)
 
   return total_freed;
 }
+
+/* Whether the pager thread is waiting to be woken up by pager_wake
+   (or is about to).  Whoever changes it from true to false owns the
+   wake up and sends the pager thread a message.  */
+static int pager_idle;
+
+/* Allocations wake the pager thread when memory runs low (see
+   pager_query).  As a fallback, the server thread checks every
+   PAGER_TICK microseconds whether collection is needed.  */
+#define PAGER_TICK (1 << 15)
+static struct timer pager_timer;
+
+static void
+pager_tick (struct timer *timer)
+{
+  int goal = pager_collect_needed ();
+  if (goal > 0)
+    pager_wake (goal);
+
+  timer_add (timer, l4_system_clock () + PAGER_TICK, pager_tick);
+}
+
+void
+pager_wake (int goal)
+{
+  if (pager_tid == l4_nilthread)
+    /* The pager thread has not yet been started.  */
+    {
+      pager_collect (goal);
+      return;
+    }
+
+  if (! atomic_exchange_acq (&pager_idle, false))
+    /* Already running or already woken.  */
+    return;
+
+  /* We may be in the middle of processing an RPC.  Only touch the
+     message tag and restore it afterwards.  The pager thread is not
+     holding any locks so this won't block for long.  */
+  l4_msg_tag_t tag = l4_msg_tag ();
+  l4_set_msg_tag (l4_niltag);
+  l4_send (pager_tid);
+  l4_set_msg_tag (tag);
+}
+
+void
+pager_loop (void)
+{
+  debug (3, "Pager loop running");
+
+  for (;;)
+    {
+      ss_mutex_lock (&kernel_lock);
+
+      if (! timer_pending (&pager_timer))
+	timer_add (&pager_timer, l4_system_clock () + PAGER_TICK,
+		   pager_tick);
+
+      int goal = pager_collect_needed ();
+      if (goal > 0)
+	pager_collect (goal);
+
+      pager_idle = true;
+      ss_mutex_unlock (&kernel_lock);
+
+      /* Wait until we are woken by pager_wake.  We can't wait on
+	 anything else: waking a thread waiting on KERNEL_LOCK would
+	 confuse the lock.  */
+      l4_receive (viengoos_tid);
+    }
+}
@@ -24,6 +24,7 @@
 #include "memory.h"
 #include "zalloc.h"
 #include "object.h"
+#include "backing-store.h"
 
 /* Try to make an additional GOAL frames available.  Returns the
    number of frames scheduled for page-out or placed on the eviction
@@ -53,12 +54,10 @@ pager_collect_needed (void)
 {
   int available_pages = zalloc_memory
     + available_list_count (&available);
-#if 0
-  /* XXX: Until we have a disk pager...  */
+  if (backing_store)
     /* We only count the pages on the laundry half as they won't be
        available immediately.  */
-    + laundry_list_count (&laundry) / 2;
-#endif
+    available_pages += laundry_list_count (&laundry) / 2;
 
   if (available_pages > PAGER_LOW_WATER_MARK
       || pager_min_alloc_before_next_collect > 0)
@@ -67,12 +66,24 @@ pager_collect_needed (void)
   return PAGER_HIGH_WATER_MARK - available_pages;
 }
 
+/* Frames are collected in the background by the pager thread, which
+   runs pager_loop.  It is woken when the number of available frames
+   drops below PAGER_LOW_WATER_MARK and collects until there are
+   PAGER_HIGH_WATER_MARK available frames.  In the meantime,
+   allocations are satisfied from the remaining free frames.  */
+extern void pager_loop (void);
+
+/* Wake the pager thread to collect GOAL frames.  If it is already
+   running, this does nothing.  If it has not yet been started,
+   collect synchronously.  Must be called with KERNEL_LOCK held.  */
+extern void pager_wake (int goal);
+
 static inline void
 pager_query (void)
 {
   int goal = pager_collect_needed ();
   if (unlikely (goal > 0))
-    pager_collect (goal);
+    pager_wake (goal);
 }
 
 #endif
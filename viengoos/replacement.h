@@ -0,0 +1,140 @@
+/* replacement.h - Frame replacement policies.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef VIENGOOS_REPLACEMENT_H
+#define VIENGOOS_REPLACEMENT_H
+
+#include "object.h"
+
+/* When reclaiming frames from an activity, the pager first takes
+   objects from the inactive lists.  These have not been referenced
+   for at least sizeof (DESC->AGE) * 8 ager periods and are taken in
+   FIFO order.  If that is not enough, it takes objects from the
+   active lists.  Which active object to take is decided by the
+   replacement policy, which is selected at build time (see
+   --with-replacement-policy).
+
+   object_desc_claim pushes objects onto the head of an active list
+   and sets the most significant bit of their age; the ager appends
+   reactivated objects to the tail.  Thus, the head holds the most
+   recently claimed objects, whose value is not yet known, and the
+   objects towards the tail have been resident the longest.
+
+     REPLACEMENT_FIFO takes the object at the head of the list.  This
+     is effectively LIFO: the most recently claimed object goes
+     first.
+
+     REPLACEMENT_ONCE prefers objects that were used once.  Starting
+     from the tail, it examines up to REPLACEMENT_WINDOW objects and
+     takes the first that was referenced in exactly one ager period,
+     but not in the last one: such an object was used once, e.g., by
+     a scan, and then not again.  If there is none, it takes the
+     object at the head, as REPLACEMENT_FIFO does.  Objects that were
+     referenced in several periods are never taken, which keeps a
+     scan from flushing the working set, and objects from an old
+     working set are taken as soon as they are no longer referenced.
+     This borrows 2Q's distinction between objects referenced once
+     and those referenced again, but it is not 2Q: it only looks at
+     the age of resident objects and keeps no history of evicted
+     ones, so an object that is faulted in again starts over as if
+     it had never been seen.
+
+     REPLACEMENT_AGING examines the last REPLACEMENT_WINDOW objects
+     and takes the one with the smallest age.  As the age is a shift
+     register of reference bits, this approximates LRU.  Like LRU, it
+     is not scan resistant.
+
+   None of the policies modify DESC->AGE: that is the ager's job.  */
+#define REPLACEMENT_FIFO 1
+#define REPLACEMENT_ONCE 2
+#define REPLACEMENT_AGING 3
+
+#ifndef REPLACEMENT_POLICY
+# define REPLACEMENT_POLICY REPLACEMENT_FIFO
+#endif
+
+/* The maximum number of objects REPLACEMENT_ONCE and REPLACEMENT_AGING
+   examine per selection.  */
+#define REPLACEMENT_WINDOW 32
+
+static inline struct object_desc *
+replacement_select_fifo (struct activity_list *active)
+{
+  return activity_list_dequeue (active);
+}
+
+static inline struct object_desc *
+replacement_select_once (struct activity_list *active)
+{
+  const uint8_t recent = 1 << (sizeof (((struct object_desc *) 0)->age) * 8
+			       - 1);
+
+  struct object_desc *desc = activity_list_tail (active);
+  int n;
+  for (n = 0;
+       desc && n < REPLACEMENT_WINDOW;
+       n ++, desc = activity_list_prev (desc))
+    /* Referenced in exactly one period, but not in the last one.  */
+    if (! (desc->age & recent) && ! (desc->age & (desc->age - 1)))
+      {
+	activity_list_unlink (active, desc);
+	return desc;
+      }
+
+  return activity_list_dequeue (active);
+}
+
+static inline struct object_desc *
+replacement_select_aging (struct activity_list *active)
+{
+  struct object_desc *victim = activity_list_tail (active);
+  if (! victim)
+    return NULL;
+
+  struct object_desc *desc = victim;
+  int i;
+  for (i = 1;
+       i < REPLACEMENT_WINDOW && victim->age
+	 && (desc = activity_list_prev (desc));
+       i ++)
+    if (desc->age < victim->age)
+      victim = desc;
+
+  activity_list_unlink (active, victim);
+  return victim;
+}
+
+/* Select an object from the active list ACTIVE to reclaim according
+   to the configured replacement policy and detach it.  Returns NULL
+   if ACTIVE is empty.  */
+static inline struct object_desc *
+replacement_select (struct activity_list *active)
+{
+#if REPLACEMENT_POLICY == REPLACEMENT_FIFO
+  return replacement_select_fifo (active);
+#elif REPLACEMENT_POLICY == REPLACEMENT_ONCE
+  return replacement_select_once (active);
+#elif REPLACEMENT_POLICY == REPLACEMENT_AGING
+  return replacement_select_aging (active);
+#else
+# error Unknown replacement policy.
+#endif
+}
+
+#endif
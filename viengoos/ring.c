@@ -0,0 +1,120 @@
+/* ring.c - Submission ring implementation.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <errno.h>
+#include <assert.h>
+#include <viengoos/misc.h>
+#include <hurd/as.h>
+
+#include "ring.h"
+#include "cap.h"
+#include "messenger.h"
+#include "output.h"
+
+bool
+ring_method_p (uintptr_t label)
+{
+  switch (label)
+    {
+    case VG_folio_alloc:
+    case VG_folio_free:
+    case VG_folio_object_alloc:
+    case VG_folio_policy:
+    case VG_folio_object_alloc_range:
+    case VG_cap_copy:
+    case VG_cap_rubout:
+    case VG_cap_read:
+    case VG_object_discarded_clear:
+    case VG_object_discard:
+    case VG_object_status:
+    case VG_object_name:
+    case VG_thread_id:
+    case VG_activity_policy:
+    case VG_messenger_id:
+      return true;
+
+    default:
+      /* Methods that may not reply immediately (e.g., VG_futex), that
+	 reply using the IPC's message registers (VG_fault) or that
+	 would nest (VG_ring_submit).  */
+      return false;
+    }
+}
+
+void
+ring_complete (struct activity *activity, struct vg_cap *as_root,
+	       struct vg_ring_entry *entry, struct vg_message *message)
+{
+  struct vg_message *reply = reply_buffer;
+
+  if (vg_message_data_count (reply) < sizeof (uintptr_t))
+    /* The method did not reply.  */
+    {
+      entry->status = EINVAL;
+      return;
+    }
+
+  entry->status = vg_message_word (reply, 0);
+
+  if (! message)
+    return;
+
+  /* The capabilities in a kernel generated reply are pointers to
+     capabilities.  Store them in the entry's reply slots.  */
+  vg_addr_t caps[VG_RING_REPLY_CAPS];
+  int cap_count = vg_message_cap_count (reply);
+  if (cap_count > VG_RING_REPLY_CAPS)
+    cap_count = VG_RING_REPLY_CAPS;
+
+  int i;
+  for (i = 0; i < cap_count; i ++)
+    {
+      caps[i] = entry->reply_caps[i];
+      if (VG_ADDR_IS_VOID (caps[i]))
+	continue;
+
+      struct vg_cap cap = VG_CAP_VOID;
+      if ((uintptr_t) vg_message_cap (reply, i).raw)
+	cap = * (struct vg_cap *) (uintptr_t) vg_message_cap (reply, i).raw;
+
+      union as_lookup_ret ret;
+      bool writable;
+      if (! as_lookup_rel (activity, as_root, caps[i], -1, &writable,
+			   as_lookup_want_slot, &ret)
+	  || ! writable)
+	{
+	  debug (0, "Reply slot " VG_ADDR_FMT " is not a writable slot",
+		 VG_ADDR_PRINTF (caps[i]));
+	  caps[i] = VG_ADDR_VOID;
+	  continue;
+	}
+
+      cap_shootdown (activity, ret.capp);
+
+      /* Preserve the address translator and policy.  */
+      struct vg_cap_properties props = VG_CAP_PROPERTIES_GET (*ret.capp);
+      *ret.capp = cap;
+      VG_CAP_PROPERTIES_SET (ret.capp, props);
+    }
+
+  vg_message_clear (message);
+  vg_message_append_caps (message, cap_count, caps);
+  vg_message_append_data (message, vg_message_data_count (reply),
+			  vg_message_data (reply));
+}
@@ -0,0 +1,50 @@
+/* ring.h - Submission ring interface.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef VIENGOOS_RING_H
+#define VIENGOOS_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <viengoos/ring.h>
+#include <viengoos/message.h>
+
+#include "cap.h"
+#include "activity.h"
+
+/* The entries of a submission ring are executed by server_loop in a
+   single pass, without dropping the kernel lock.  Each entry is
+   dispatched like a normal invocation, except that there is no reply
+   messenger: the reply is left in REPLY_BUFFER and then copied to the
+   entry using ring_complete.  */
+
+/* Return whether the method LABEL may be invoked from a submission
+   ring.  */
+extern bool ring_method_p (uintptr_t label);
+
+/* ENTRY, which designates the message buffer MESSAGE, has been
+   executed and its reply is in REPLY_BUFFER.  Set the entry's status,
+   store any returned capabilities in the slots named by the entry
+   (looked up relative to AS_ROOT) and copy the reply to MESSAGE.  If
+   MESSAGE is NULL, only the status is set.  */
+extern void ring_complete (struct activity *activity, struct vg_cap *as_root,
+			   struct vg_ring_entry *entry,
+			   struct vg_message *message);
+
+#endif
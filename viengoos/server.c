@@ -41,11 +41,91 @@
 #include "messenger.h"
 #include "viengoos.h"
 #include "profile.h"
+#include "superpage.h"
+#include "futex.h"
+#include "ring.h"
+#include "timer.h"
 
 #ifndef NDEBUG
 struct futex_waiter_list futex_waiters;
 #endif
 
+/* Map a method id to the method's index (see VG_METHOD_INDEX).  */
+#define METHOD_INDEXES_INIT_(name_) [VG_##name_] = VG_METHOD_INDEX (name_),
+static const uint8_t method_indexes[VG_METHOD_ID_LIMIT] =
+  { VG_METHODS (METHOD_INDEXES_INIT_) };
+#undef METHOD_INDEXES_INIT_
+
+/* Besides the methods, we account page faults, message transfers
+   between messengers, fast queries and running expired timers.  */
+enum
+  {
+    METHOD_INDEX_PAGEFAULT = VG_METHOD_COUNT,
+    METHOD_INDEX_IPC,
+    METHOD_INDEX_FAST,
+    METHOD_INDEX_TIMERS,
+    METHOD_INDEX_COUNT
+  };
+
+#define METHOD_NAMES_INIT_(name_) [VG_METHOD_INDEX (name_)] = #name_,
+static const char *const method_names[METHOD_INDEX_COUNT] =
+  {
+    [VG_METHOD_INDEX_none] = "unknown method id",
+    VG_METHODS (METHOD_NAMES_INIT_)
+    [METHOD_INDEX_PAGEFAULT] = "pagefault",
+    [METHOD_INDEX_IPC] = "IPC",
+    [METHOD_INDEX_FAST] = "fast query",
+    [METHOD_INDEX_TIMERS] = "timers",
+  };
+#undef METHOD_NAMES_INIT_
+
+/* Return the index of the method with id LABEL.  */
+static inline int
+method_index (uintptr_t label)
+{
+  if (label >= VG_METHOD_ID_LIMIT)
+    return VG_METHOD_INDEX_none;
+  return method_indexes[label];
+}
+
+/* Return the name of the method with id LABEL.  */
+static inline const char *
+method_name (uintptr_t label)
+{
+  return method_names[method_index (label)];
+}
+
+/* Per-method statistics, indexed by method index.  */
+static struct
+{
+  uint64_t calls;
+  /* The total and the maximum time spent handling a call, in
+     microseconds.  */
+  uint64_t time;
+  uint64_t max;
+} method_stats[METHOD_INDEX_COUNT];
+
+static inline void
+method_stats_account (int method, uint64_t time)
+{
+  method_stats[method].calls ++;
+  method_stats[method].time += time;
+  if (time > method_stats[method].max)
+    method_stats[method].max = time;
+}
+
+void
+server_method_stats_dump (void)
+{
+  int i;
+  for (i = 0; i < METHOD_INDEX_COUNT; i ++)
+    if (method_stats[i].calls)
+      debug (1, "%s: %lld calls, %lld us (avg: %lld us, max: %lld us)",
+	     method_names[i], method_stats[i].calls, method_stats[i].time,
+	     method_stats[i].time / method_stats[i].calls,
+	     method_stats[i].max);
+}
+
 #ifndef NDEBUG
 
 struct trace_buffer rpc_trace = TRACE_BUFFER_INIT ("rpcs", 0,
@@ -61,12 +141,12 @@ struct trace_buffer rpc_trace = TRACE_BUFFER_INIT ("rpcs", 0,
 			  thread->tid,					\
 			  l4_is_pagefault (msg_tag) ? "pagefault"	\
 			  : label == 8194 ? "IPC"			\
-			  : vg_method_id_string (label),		\
+			  : method_name (label),			\
 			  label,					\
 			  ##args);					\
       debug (level, "(%x %s:%d %d) " format,				\
 	     thread->tid, l4_is_pagefault (msg_tag) ? "pagefault"	\
-	     : label == 8194 ? "IPC" : vg_method_id_string (label),	\
+	     : label == 8194 ? "IPC" : method_name (label),		\
 	     __LINE__, label,						\
 	     ##args);							\
     }									\
@@ -76,12 +156,221 @@ struct trace_buffer rpc_trace = TRACE_BUFFER_INIT ("rpcs", 0,
 # define DEBUG(level, format, args...)					\
       debug (level, "(%x %s:%d %d) " format,				\
 	     thread->tid, l4_is_pagefault (msg_tag) ? "pagefault"	\
-	     : label == 8194 ? "IPC" : vg_method_id_string (label),	\
+	     : label == 8194 ? "IPC" : method_name (label),		\
 	     __LINE__, label,						\
 	     ##args)
 #endif
 
-#define PAGEFAULT_METHOD 2
+#ifndef NDEBUG
+/* If no IPC is received for this long (in microseconds), we suspect
+   a dead-lock.  */
+#define SERVER_IDLE_TIMEOUT (5000 * 1000)
+
+/* When the last IPC was received.  */
+static uint64_t server_last_ipc;
+/* Whether the rpc trace was dumped since the last IPC.  */
+static bool rpc_trace_just_dumped;
+static struct timer server_idle_timer;
+
+/* Check whether we have received an IPC in the last
+   SERVER_IDLE_TIMEOUT microseconds.  If not, perhaps there is a
+   dead-lock: dump the rpc trace.  */
+static void
+server_idle_check (struct timer *timer)
+{
+  uint64_t now = l4_system_clock ();
+  if (now - server_last_ipc < SERVER_IDLE_TIMEOUT)
+    {
+      timer_add (timer, server_last_ipc + SERVER_IDLE_TIMEOUT,
+		 server_idle_check);
+      return;
+    }
+
+  if (! rpc_trace_just_dumped)
+    {
+      debug (0, "No IPCs for some time.  Deadlock?");
+
+      struct messenger *messenger;
+      while ((messenger = futex_waiter_list_head (&futex_waiters)))
+	{
+	  object_wait_queue_unlink (root_activity, messenger);
+	  rpc_error_reply (root_activity, messenger, EDEADLK);
+	}
+
+      trace_buffer_dump (&rpc_trace, 0);
+      rpc_trace_just_dumped = true;
+    }
+
+  timer_add (timer, now + SERVER_IDLE_TIMEOUT, server_idle_check);
+}
+#endif
+
+#ifdef SUPERPAGES
+/* PAGE is mapped at PAGE_ADDR in THREAD's address space.  Return
+   whether the SUPERPAGE_SIZE region containing PAGE_ADDR can be
+   mapped with a single fpage (see superpage.h).  If so, mark the
+   objects as mapped.  The region's other objects are not paged in:
+   if any of them is not in memory, the region is not mappable.  */
+static bool
+superpage_mappable (struct activity *activity, struct thread *thread,
+		    uintptr_t page_addr, struct vg_object *page,
+		    bool writable)
+{
+  struct object_desc *desc = object_to_object_desc (page);
+  uintptr_t base = superpage_base (desc);
+  if (! base)
+    return false;
+
+  uintptr_t start = page_addr & ~(SUPERPAGE_SIZE - 1);
+  if ((uintptr_t) page - base != page_addr - start)
+    /* The region is not aligned with the reservation.  */
+    return false;
+
+  vg_oid_t group = desc->oid - (page_addr - start) / PAGESIZE;
+
+  int j;
+  for (j = 0; j < SUPERPAGE_OBJECTS; j ++)
+    {
+      uintptr_t addr = start + j * PAGESIZE;
+      if (addr == page_addr)
+	continue;
+
+      bool w;
+      struct vg_cap cap
+	= as_object_lookup_rel (activity, &thread->aspace,
+				vg_addr_chop (VG_PTR_TO_ADDR (addr),
+					      PAGESIZE_LOG2),
+				vg_cap_rpage, &w);
+      if ((cap.type != vg_cap_page && cap.type != vg_cap_rpage)
+	  || cap.oid != group + j || w != writable)
+	return false;
+
+      if (! w && cap.discardable)
+	cap.discardable = false;
+
+      if (cap_to_object_soft (activity, &cap)
+	  != (struct vg_object *) (base + j * PAGESIZE))
+	return false;
+    }
+
+  /* Looking up the objects may have claimed them and broken the
+     reservation.  */
+  for (j = 0; j < SUPERPAGE_OBJECTS; j ++)
+    {
+      struct object_desc *d
+	= object_to_object_desc ((struct vg_object *) (base + j * PAGESIZE));
+      if (! d->superpage
+	  || d->activity != desc->activity
+	  || d->policy.priority != desc->policy.priority
+	  || d->policy.discardable != desc->policy.discardable
+	  || d->eviction_candidate)
+	return false;
+    }
+
+  for (j = 0; j < SUPERPAGE_OBJECTS; j ++)
+    object_to_object_desc ((struct vg_object *) (base + j * PAGESIZE))
+      ->mapped = true;
+
+  return true;
+}
+#endif
+
+/* Handle a fast query (see vg_ipc_fast) from thread FROM.  MSG
+   contains the request.  Formulate the reply in MSG.  Returns whether
+   the kernel lock was taken (in which case, it is still held).  */
+static bool
+fast_query (l4_thread_id_t from, l4_msg_t msg)
+{
+  uintptr_t method = l4_msg_word (msg, 0);
+  vg_addr_t addr;
+  int i;
+  for (i = 0; i < sizeof (vg_addr_t) / sizeof (uintptr_t); i ++)
+    ((uintptr_t *) &addr)[i] = l4_msg_word (msg, 1 + i);
+  uintptr_t arg = l4_msg_word (msg, 1 + i);
+
+  error_t err = 0;
+  uintptr_t result = 0;
+  bool have_lock = false;
+
+  if (method == VG_thread_id && VG_ADDR_IS_VOID (addr))
+    /* The caller's id is the sender's id.  This does not depend on
+       any kernel state, so we don't need the lock.  */
+    result = from;
+  else if (method == VG_thread_id || method == VG_object_status)
+    {
+      ss_mutex_lock (&kernel_lock);
+      have_lock = true;
+
+      struct thread *thread = thread_lookup (from);
+      struct activity *activity
+	= (struct activity *) vg_cap_to_object (root_activity,
+						&thread->activity);
+      if (! activity
+	  || (object_type ((struct vg_object *) activity)
+	      != vg_cap_activity_control))
+	{
+	  err = EINVAL;
+	  goto out;
+	}
+
+      struct vg_object *target;
+      bool writable = true;
+      if (VG_ADDR_IS_VOID (addr))
+	target = (struct vg_object *) thread;
+      else
+	{
+	  struct vg_cap cap = as_object_lookup_rel (activity, &thread->aspace,
+						    addr, -1, &writable);
+	  target = vg_cap_to_object (activity, &cap);
+	}
+      if (! target)
+	{
+	  err = ENOENT;
+	  goto out;
+	}
+      if (object_type (target) == vg_cap_messenger && ! writable)
+	/* A normal invocation would forward the message to the
+	   messenger's owner.  */
+	{
+	  err = EINVAL;
+	  goto out;
+	}
+
+      if (method == VG_thread_id)
+	{
+	  if (object_type (target) != vg_cap_thread)
+	    err = EINVAL;
+	  else
+	    result = ((struct thread *) target)->tid;
+	}
+      else
+	{
+	  struct object_desc *desc = object_to_object_desc (target);
+	  result = (desc->user_referenced ? vg_object_referenced : 0)
+	    | (desc->user_dirty ? vg_object_dirty : 0);
+
+	  if (arg)
+	    {
+	      desc->user_referenced = 0;
+	      desc->user_dirty = 0;
+	    }
+	}
+    }
+  else
+    err = ENOSYS;
+
+ out:
+  debug (5, "%x: %s (" VG_ADDR_FMT ", %x) -> %d, %x",
+	 from, method_name (method), VG_ADDR_PRINTF (addr), arg,
+	 err, result);
+
+  l4_msg_clear (msg);
+  l4_msg_put_word (msg, 0, err);
+  l4_msg_put_word (msg, 1, result);
+  l4_msg_set_untyped_words (msg, 2);
+
+  return have_lock;
+}
 
 void
 server_loop (void)
@@ -92,24 +381,40 @@ server_loop (void)
   l4_thread_id_t to = l4_nilthread;
   l4_msg_t msg;
 
-  bool have_lock = false;
+  ss_mutex_lock (&kernel_lock);
+  bool have_lock = true;
 #ifndef NDEBUG
-  bool rpc_trace_just_dumped = false;
+  server_last_ipc = l4_system_clock ();
+  timer_add (&server_idle_timer, server_last_ipc + SERVER_IDLE_TIMEOUT,
+	     server_idle_check);
 #endif
 
-  /* Profiling.  */
+  /* The index of the method being handled and when we started
+     handling it.  */
   int method = -1;
+  uint64_t method_start = 0;
+
+  /* When timers_run next needs to be called.  Only recomputed when we
+     have the lock: fast queries that don't take the lock don't change
+     it.  */
+  uint64_t timer_next = 0;
 
   for (;;)
     {
       if (method != -1)
 	{
-	  profile_end (method);
+	  method_stats_account (method, l4_system_clock () - method_start);
 	  method = -1;
 	}
 
       if (have_lock)
 	{
+	  uint64_t timers_start = l4_system_clock ();
+	  if (timers_run ())
+	    method_stats_account (METHOD_INDEX_TIMERS,
+				  l4_system_clock () - timers_start);
+	  timer_next = timers_next ();
+
 	  ss_mutex_unlock (&kernel_lock);
 	  have_lock = false;
 	}
@@ -117,12 +422,13 @@ server_loop (void)
       l4_thread_id_t from = l4_anythread;
       l4_msg_tag_t msg_tag;
 
-#ifndef NDEBUG
-      l4_time_t max_idle
-	= rpc_trace_just_dumped ? L4_NEVER : l4_time_period (5000 * 1000);
-#else
+      /* Don't sleep past the next timer tick.  */
       l4_time_t max_idle = L4_NEVER;
-#endif
+      if (timer_next)
+	{
+	  uint64_t now = l4_system_clock ();
+	  max_idle = l4_time_period (timer_next > now ? timer_next - now : 1);
+	}
 
       /* Only accept untyped items--no strings, no mappings.  */
       l4_accept (L4_UNTYPED_WORDS_ACCEPTOR);
@@ -137,25 +443,16 @@ server_loop (void)
 
       if (l4_ipc_failed (msg_tag))
 	{
-#ifndef NDEBUG
 	  if ((l4_error_code () & 1) && ((l4_error_code () >> 1) & 0x7) == 1)
-	    /* Receive timeout.  This means that we have not gotten
-	       any message in the last few seconds.  Perhaps there is
-	       a dead-lock.  Dump the rpc trace.  */
+	    /* Receive timeout.  Take the lock: the timers are run at
+	       the top of the loop.  */
 	    {
-	      debug (0, "No IPCs for some time.  Deadlock?");
-
-	      struct messenger *messenger;
-	      while ((messenger = futex_waiter_list_head (&futex_waiters)))
-		{
-		  object_wait_queue_unlink (root_activity, messenger);
-		  rpc_error_reply (root_activity, messenger, EDEADLK);
-		}
+	      ss_mutex_lock (&kernel_lock);
+	      have_lock = true;
 
-	      trace_buffer_dump (&rpc_trace, 0);
-	      rpc_trace_just_dumped = true;
+	      do_reply = 0;
+	      continue;
 	    }
-#endif
 
 	  debug (4, "%s %x failed: %u", 
 		 l4_error_code () & 1 ? "Receiving from" : "Sending to",
@@ -167,7 +464,10 @@ server_loop (void)
 	}
 #ifndef NDEBUG
       else
-	rpc_trace_just_dumped = false;
+	{
+	  server_last_ipc = l4_system_clock ();
+	  rpc_trace_just_dumped = false;
+	}
 #endif
 
       l4_msg_store (msg_tag, msg);
@@ -182,7 +482,7 @@ server_loop (void)
       debug (5, "%x (p: %d, %x) sent %s (%x)",
 	     from, l4_ipc_propagated (msg_tag), l4_actual_sender (),
 	     (l4_is_pagefault (msg_tag) ? "fault handler"
-	      : vg_method_id_string (label)),
+	      : method_name (label)),
 	     label);
 
       if (l4_version (l4_myself ()) == l4_version (from))
@@ -190,21 +490,30 @@ server_loop (void)
 	panic ("Kernel thread %x (propagated: %d, actual: %x) sent %s? (%x)!",
 	       from, l4_ipc_propagated (msg_tag), l4_actual_sender (),
 	       (l4_is_pagefault (msg_tag) ? "fault handler"
-		      : vg_method_id_string (label)),
+		      : method_name (label)),
 	       label);
 
+      if (label == VG_IPC_FAST_LABEL)
+	{
+	  method = METHOD_INDEX_FAST;
+	  method_start = l4_system_clock ();
+
+	  have_lock = fast_query (from, msg);
+	  do_reply = 1;
+	  continue;
+	}
+
       ss_mutex_lock (&kernel_lock);
       have_lock = true;
 
 
-      /* Start timer.  */
+      /* Start timer.  If the IPC invokes a kernel object, the time is
+	 accounted to the method.  */
       if (l4_is_pagefault (msg_tag))
-	method = PAGEFAULT_METHOD;
+	method = METHOD_INDEX_PAGEFAULT;
       else
-	method = label;
-      profile_start (method,
-		     method == PAGEFAULT_METHOD ? "fault handler"
-		     : vg_method_id_string (method), NULL);
+	method = METHOD_INDEX_IPC;
+      method_start = l4_system_clock ();
 
       /* Find the sender.  */
       struct thread *thread = thread_lookup (from);
@@ -248,6 +557,8 @@ server_loop (void)
 	  DEBUG (4, "%s fault at %x (ip: %x)",
 		 write_fault ? "Write" : "Read", fault, ip);
 
+	  ACTIVITY_STATS (activity)->faults ++;
+
 	  uintptr_t page_addr = fault & ~(PAGESIZE - 1);
 
 	  struct vg_cap cap;
@@ -347,11 +658,22 @@ server_loop (void)
 	  if (writable)
 	    access |= L4_FPAGE_WRITABLE;
 
+	  l4_fpage_t fpage = l4_fpage ((uintptr_t) page, PAGESIZE);
+	  uintptr_t map_addr = page_addr;
+#ifdef SUPERPAGES
+	  if (superpage_mappable (activity, thread, page_addr, page, writable))
+	    {
+	      map_addr = page_addr & ~(SUPERPAGE_SIZE - 1);
+	      fpage = l4_fpage ((uintptr_t) page - (page_addr - map_addr),
+				SUPERPAGE_SIZE);
+
+	      DEBUG (4, "Mapping superpage " DEBUG_BOLD ("%x") " <- %x",
+		     map_addr, l4_address (fpage));
+	    }
+#endif
+
 	  l4_map_item_t map_item
-	    = l4_map_item
-	       (l4_fpage_add_rights (l4_fpage ((uintptr_t) page, PAGESIZE),
-				     access),
-		page_addr);
+	    = l4_map_item (l4_fpage_add_rights (fpage, access), map_addr);
 
 	  /* Formulate the reply message.  */
 	  l4_pagefault_reply_formulate_in (msg, &map_item);
@@ -412,6 +734,30 @@ server_loop (void)
 
       struct activity *principal;
 
+      /* If not NULL, the submission ring whose entries are being
+	 executed (see VG_ring_submit).  The entries are executed one
+	 at a time: each is dispatched like a normal invocation and
+	 then completed at OUT.  */
+      struct vg_ring *ring = NULL;
+      struct vg_cap ring_cap;
+      /* The entry being executed and when it was started.  */
+      struct vg_ring_entry ring_entry;
+      bool ring_pending = false;
+      uint64_t ring_start = 0;
+      /* The number of entries executed so far.  */
+      int ring_count = 0;
+      /* Where to send the reply to VG_ring_submit.  */
+      struct messenger *ring_reply = NULL;
+      /* An entry may destroy any object, including the ones used to
+	 execute the ring.  These are looked up again after each
+	 entry using the capabilities recorded when the ring was
+	 submitted.  */
+      struct vg_cap ring_thread_cap;
+      struct vg_cap ring_activity_cap;
+      struct vg_cap ring_principal_cap;
+      struct vg_cap ring_source_cap;
+      struct vg_cap ring_reply_cap;
+
   /* Create a message indicating an error with the error code ERR_.
      Go to the start of the server loop.  */
 #define REPLY(err_)						\
@@ -921,7 +1267,7 @@ server_loop (void)
 	{							\
 	  if (err_)						\
 	    DEBUG (0, DEBUG_BOLD ("Returning error %d"), err_);	\
-	  if (reply)						\
+	  if (reply || ring)					\
 	    if (rpc_error_reply (principal, reply, err_))	\
 	      DEBUG (0, DEBUG_BOLD ("Failed to send reply"));	\
 	  goto out;						\
@@ -977,6 +1323,7 @@ server_loop (void)
 		  vg_message_cap (message, 0),
 		  vg_cap_rmessenger, false, NULL);
 
+    ring_dispatch:;
       /* There are a number of methods that look up an object relative
 	 to the invoked object.  Generate an appropriate root for
 	 them.  */
@@ -1005,9 +1352,14 @@ server_loop (void)
 	       VG_OID_PRINTF (object_oid ((struct vg_object *) reply)),
 	       reply->id);
 
-      switch (label)
+      /* Dispatch using the method's index: the indexes are dense.  */
+      int index = method_index (label);
+      if (! ring)
+	method = index;
+
+      switch (index)
 	{
-	case VG_write:
+	case VG_METHOD_INDEX (write):
 	  {
 	    struct io_buffer buffer;
 	    err = vg_write_send_unmarshal (message, &buffer, NULL);
@@ -1021,7 +1373,7 @@ server_loop (void)
 	    vg_write_reply (activity, reply);
 	    break;
 	  }
-	case VG_read:
+	case VG_METHOD_INDEX (read):
 	  {
 	    int max;
 	    err = vg_read_send_unmarshal (message, &max, NULL);
@@ -1044,7 +1396,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_fault:
+	case VG_METHOD_INDEX (fault):
 	  {
 	    uintptr_t start;
 	    int max;
@@ -1115,7 +1467,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_folio_alloc:
+	case VG_METHOD_INDEX (folio_alloc):
 	  {
 	    if (object_type (target) != vg_cap_activity_control)
 	      {
@@ -1143,7 +1495,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_folio_free:
+	case VG_METHOD_INDEX (folio_free):
 	  {
 	    if (object_type (target) != vg_cap_folio)
 	      REPLY (EINVAL);
@@ -1162,7 +1514,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_folio_object_alloc:
+	case VG_METHOD_INDEX (folio_object_alloc):
 	  {
 	    if (object_type (target) != vg_cap_folio)
 	      REPLY (EINVAL);
@@ -1209,7 +1561,76 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_folio_policy:
+	case VG_METHOD_INDEX (folio_object_alloc_range):
+	  {
+	    if (object_type (target) != vg_cap_folio)
+	      REPLY (EINVAL);
+
+	    struct vg_folio *folio = (struct vg_folio *) target;
+
+	    uintptr_t idx;
+	    uintptr_t count;
+	    uintptr_t type;
+	    struct vg_object_policy policy;
+	    vg_addr_t addr;
+
+	    err = vg_folio_object_alloc_range_send_unmarshal (message,
+							      &idx, &count,
+							      &type, &policy,
+							      &addr, NULL);
+	    if (err)
+	      REPLY (err);
+
+	    DEBUG (4, "(" VG_ADDR_FMT ", %d+%d, %s, (%s, %d), " VG_ADDR_FMT ")",
+		   VG_ADDR_PRINTF (target_messenger), idx, count,
+		   vg_cap_type_string (type),
+		   policy.discardable ? "discardable" : "precious",
+		   policy.priority, VG_ADDR_PRINTF (addr));
+
+	    if (count == 0 || idx >= VG_FOLIO_OBJECTS
+		|| count > VG_FOLIO_OBJECTS - idx)
+	      REPLY (EINVAL);
+
+	    if (! (VG_CAP_TYPE_MIN <= type && type <= VG_CAP_TYPE_MAX))
+	      REPLY (EINVAL);
+
+	    /* Look up all of the slots before allocating anything so
+	       that a bad slot does not leave the range half allocated.
+	       A slot must not lie in one of the objects being
+	       allocated: allocating it clears its content or frees its
+	       frame.  */
+	    struct vg_cap *slots[VG_FOLIO_OBJECTS];
+	    if (! VG_ADDR_IS_VOID (addr))
+	      {
+		vg_oid_t first = object_oid ((struct vg_object *) folio)
+		  + 1 + idx;
+
+		int i;
+		for (i = 0; i < count; i ++)
+		  {
+		    slots[i] = SLOT (&thread->aspace, vg_addr_add (addr, i));
+
+		    vg_oid_t oid
+		      = object_oid ((struct vg_object *)
+				    ((uintptr_t) slots[i] & ~(PAGESIZE - 1)));
+		    if (first <= oid && oid < first + count)
+		      {
+			DEBUG (1, "Slot " VG_ADDR_FMT " is in the range",
+			       VG_ADDR_PRINTF (vg_addr_add (addr, i)));
+			REPLY (EINVAL);
+		      }
+		  }
+	      }
+
+	    folio_object_alloc_range (principal, folio, idx, count,
+				      type, policy, 0,
+				      VG_ADDR_IS_VOID (addr) ? NULL : slots);
+
+	    vg_folio_object_alloc_range_reply (activity, reply);
+	    break;
+	  }
+
+	case VG_METHOD_INDEX (folio_policy):
 	  {
 	    if (object_type (target) != vg_cap_folio)
 	      REPLY (EINVAL);
@@ -1232,7 +1653,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_cap_copy:
+	case VG_METHOD_INDEX (cap_copy):
 	  {
 	    vg_addr_t source_as_addr;
 	    vg_addr_t source_addr;
@@ -1390,7 +1811,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_cap_rubout:
+	case VG_METHOD_INDEX (cap_rubout):
 	  {
 	    vg_addr_t addr;
 
@@ -1414,7 +1835,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_cap_read:
+	case VG_METHOD_INDEX (cap_read):
 	  {
 	    vg_addr_t cap_addr;
 
@@ -1438,7 +1859,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_object_discarded_clear:
+	case VG_METHOD_INDEX (object_discarded_clear):
 	  {
 	    vg_addr_t object_addr;
 
@@ -1530,7 +1951,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_object_discard:
+	case VG_METHOD_INDEX (object_discard):
 	  {
 	    err = vg_object_discard_send_unmarshal (message, NULL);
 	    if (err)
@@ -1547,7 +1968,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_object_status:
+	case VG_METHOD_INDEX (object_status):
 	  {
 	    bool clear;
 	    err = vg_object_status_send_unmarshal (message, &clear, NULL);
@@ -1572,7 +1993,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_object_name:
+	case VG_METHOD_INDEX (object_name):
 	  {
 	    struct vg_object_name name;
 	    err = vg_object_name_send_unmarshal (message, &name, NULL);
@@ -1596,7 +2017,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_thread_exregs:
+	case VG_METHOD_INDEX (thread_exregs):
 	  {
 	    if (object_type (target) != vg_cap_thread)
 	      REPLY (EINVAL);
@@ -1706,7 +2127,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_thread_id:
+	case VG_METHOD_INDEX (thread_id):
 	  {
 	    if (object_type (target) != vg_cap_thread)
 	      REPLY (EINVAL);
@@ -1720,7 +2141,7 @@ server_loop (void)
 	    break;	    
 	  }
 
-	case VG_object_reply_on_destruction:
+	case VG_METHOD_INDEX (object_reply_on_destruction):
 	  {
 	    err = vg_object_reply_on_destruction_send_unmarshal (message,
 								 NULL);
@@ -1729,13 +2150,16 @@ server_loop (void)
 
 	    DEBUG (4, VG_ADDR_FMT, VG_ADDR_PRINTF (target_messenger));
 
+	    if (! reply)
+	      REPLY (EINVAL);
+
 	    reply->wait_reason = MESSENGER_WAIT_DESTROY;
 	    object_wait_queue_enqueue (principal, target, reply);
 
 	    break;
 	  }
 
-	case VG_activity_policy:
+	case VG_METHOD_INDEX (activity_policy):
 	  {
 	    if (object_type (target) != vg_cap_activity_control)
 	      {
@@ -1808,7 +2232,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_activity_info:
+	case VG_METHOD_INDEX (activity_info):
 	  {
 	    if (object_type (target) != vg_cap_activity_control)
 	      REPLY (EINVAL);
@@ -1863,6 +2287,11 @@ server_loop (void)
 	    else if (flags)
 	      /* Queue thread on the activity.  */
 	      {
+		if (! reply)
+		  /* There is no messenger to queue, e.g., because the
+		     method was submitted using a ring.  */
+		  REPLY (EINVAL);
+
 		reply->wait_reason = MESSENGER_WAIT_ACTIVITY_INFO;
 		reply->wait_reason_arg = flags;
 		reply->wait_reason_arg2 = until_period;
@@ -1875,7 +2304,36 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_thread_activation_collect:
+	case VG_METHOD_INDEX (activity_stats_page):
+	  {
+	    if (object_type (target) != vg_cap_activity_control)
+	      REPLY (EINVAL);
+	    struct activity *activity = (struct activity *) target;
+
+	    vg_addr_t page_addr;
+	    err = vg_activity_stats_page_send_unmarshal (message, &page_addr,
+							 NULL);
+	    if (err)
+	      REPLY (err);
+
+	    DEBUG (4, OBJECT_NAME_FMT ": " VG_ADDR_FMT,
+		   OBJECT_NAME_PRINTF ((struct vg_object *) activity),
+		   VG_ADDR_PRINTF (page_addr));
+
+	    if (VG_ADDR_IS_VOID (page_addr))
+	      activity->stats_page = VG_CAP_VOID;
+	    else
+	      {
+		activity->stats_page = CAP (&thread->aspace, page_addr,
+					    vg_cap_page, true);
+		activity_stats_publish (activity);
+	      }
+
+	    vg_activity_stats_page_reply (principal, reply);
+	    break;
+	  }
+
+	case VG_METHOD_INDEX (thread_activation_collect):
 	  {
 	    if (object_type (target) != vg_cap_thread)
 	      REPLY (EINVAL);
@@ -1890,7 +2348,7 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_as_dump:
+	case VG_METHOD_INDEX (as_dump):
 	  {
 	    err = vg_as_dump_send_unmarshal (message, NULL);
 	    if (err)
@@ -1903,52 +2361,8 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_futex:
+	case VG_METHOD_INDEX (futex):
 	  {
-	    /* Helper function to wake and requeue waiters.  */
-	    int wake (int to_wake, struct vg_object *object1, int offset1,
-		      int to_requeue, struct vg_object *object2, int offset2)
-	    {
-	      int count = 0;
-	      struct messenger *m;
-
-	      object_wait_queue_for_each (principal, object1, m)
-		if (m->wait_reason == MESSENGER_WAIT_FUTEX
-		    && m->wait_reason_arg == offset1)
-		  /* Got a match.  */
-		  {
-		    if (count < to_wake)
-		      {
-			object_wait_queue_unlink (principal, m);
-
-			debug (5, "Waking messenger");
-
-			err = vg_futex_reply (principal, m, 0);
-			if (err)
-			  panic ("Error vg_futex waking: %d", err);
-
-			count ++;
-
-			if (count == to_wake && to_requeue == 0)
-			  break;
-		      }
-		    else
-		      {
-			object_wait_queue_unlink (principal, m);
-
-			m->wait_reason_arg = offset2;
-			object_wait_queue_enqueue (principal, object2, m);
-
-			count ++;
-
-			to_requeue --;
-			if (to_requeue == 0)
-			  break;
-		      }
-		  }
-	      return count;
-	    }
-
 	    void *addr1;
 	    int op;
 	    int val1;
@@ -2026,17 +2440,10 @@ server_loop (void)
 		if (*vaddr1 != val1)
 		  REPLY (EWOULDBLOCK);
 
-		if (timeout)
-		  panic ("Timeouts not yet supported");
-
-		reply->wait_reason = MESSENGER_WAIT_FUTEX;
-		reply->wait_reason_arg = offset1;
-
-		object_wait_queue_enqueue (principal, object1, reply);
-
-#ifndef NDEBUG
-		futex_waiter_list_enqueue (&futex_waiters, reply);
-#endif
+		err = futex_wait (principal, object1, offset1,
+				  timeout ? &val2.timespec : NULL, reply);
+		if (err)
+		  REPLY (err);
 
 		break;
 
@@ -2048,7 +2455,7 @@ server_loop (void)
 		if (val1 <= 0)
 		  REPLY (EINVAL);
 
-		int count = wake (val1, object1, offset1, 0, 0, 0);
+		int count = futex_wake (principal, val1, object1, offset1, 0, 0, 0);
 		vg_futex_reply (activity, reply, count);
 		break;
 
@@ -2080,7 +2487,7 @@ server_loop (void)
 		    break;
 		  }
 
-		count = wake (1, object1, offset1, 0, 0, 0);
+		count = futex_wake (principal, 1, object1, offset1, 0, 0, 0);
 
 		bool comparison;
 		switch (val3.cmp)
@@ -2106,7 +2513,8 @@ server_loop (void)
 		  }
 
 		if (comparison)
-		  count += wake (val2.value, object2, offset2, 0, 0, 0);
+		  count += futex_wake (principal, val2.value, object2, offset2,
+				       0, 0, 0);
 
 		vg_futex_reply (activity, reply, 0);
 		break;
@@ -2126,8 +2534,8 @@ server_loop (void)
 		object2 = OBJECT (target_root, addr, vg_cap_page, true, NULL);
 		offset2 = (uintptr_t) addr2 & (PAGESIZE - 1);
 
-		count = wake (val1, object1, offset1,
-			      val2.value, object2, offset2);
+		count = futex_wake (principal, val1, object1, offset1,
+				    val2.value, object2, offset2);
 		vg_futex_reply (activity, reply, count);
 		break;
 	      }
@@ -2135,7 +2543,39 @@ server_loop (void)
 	    break;
 	  }
 
-	case VG_messenger_id:
+	case VG_METHOD_INDEX (ring_submit):
+	  {
+	    if (object_type (target) != vg_cap_thread)
+	      REPLY (EINVAL);
+
+	    vg_addr_t ring_addr;
+	    err = vg_ring_submit_send_unmarshal (message, &ring_addr, NULL);
+	    if (err)
+	      REPLY (err);
+
+	    ring_cap = CAP (&thread->aspace, ring_addr, vg_cap_page, true);
+	    ring = (struct vg_ring *) vg_cap_to_object (principal, &ring_cap);
+	    if (! ring)
+	      REPLY (ENOENT);
+
+	    DEBUG (4, "(" VG_ADDR_FMT ": %d..%d)",
+		   VG_ADDR_PRINTF (ring_addr), ring->tail, ring->head);
+
+	    /* The entries are executed at OUT.  */
+	    ring_reply = reply;
+	    ring_count = 0;
+
+	    ring_thread_cap = object_to_cap ((struct vg_object *) thread);
+	    ring_activity_cap = object_to_cap ((struct vg_object *) activity);
+	    ring_principal_cap
+	      = object_to_cap ((struct vg_object *) principal);
+	    ring_source_cap = object_to_cap ((struct vg_object *) source);
+	    if (reply)
+	      ring_reply_cap = object_to_cap ((struct vg_object *) reply);
+	    break;
+	  }
+
+	case VG_METHOD_INDEX (messenger_id):
 	  {
 	    if (object_type (target) != vg_cap_messenger || ! target_writable)
 	      REPLY (EINVAL);
@@ -2168,7 +2608,106 @@ server_loop (void)
 	  do_reply = 1;
 	}
       
-    out:;
+    out:
+      if (ring)
+	/* Complete the entry that was just executed, if any, and
+	   start the next one.  Revalidate the objects used to execute
+	   the ring and the ring itself: the entry may have freed them.
+	   If any is gone, stop.  */
+	{
+	  if (vg_cap_to_object (root_activity, &ring_thread_cap)
+	      != (struct vg_object *) thread
+	      || vg_cap_to_object (root_activity, &ring_activity_cap)
+	      != (struct vg_object *) activity
+	      || vg_cap_to_object (activity, &ring_principal_cap)
+	      != (struct vg_object *) principal
+	      || vg_cap_to_object (principal, &ring_source_cap)
+	      != (struct vg_object *) source
+	      || (ring_reply
+		  && vg_cap_to_object (principal, &ring_reply_cap)
+		  != (struct vg_object *) ring_reply))
+	    {
+	      DEBUG (1, "Object used by ring destroyed, stopping after "
+		     "%d entries", ring_count);
+	      ring = NULL;
+	      ring_reply = NULL;
+	    }
+	  else
+	    ring = (struct vg_ring *) vg_cap_to_object (principal, &ring_cap);
+	  if (ring_pending)
+	    method_stats_account (method_index (label),
+				  l4_system_clock () - ring_start);
+	  if (ring && ring_pending)
+	    {
+	      struct vg_object *page = NULL;
+	      OBJECT_ (&thread->aspace, ring_entry.buffer, vg_cap_page, true,
+		       &page, NULL);
+	      ring_complete (principal, &thread->aspace,
+			     &ring->entries[ring->tail % VG_RING_ENTRIES],
+			     (struct vg_message *) page);
+	      ring->tail ++;
+	      ring_count ++;
+	    }
+	  ring_pending = false;
+
+	  while (ring && ring->tail != ring->head
+		 && ring_count < VG_RING_ENTRIES)
+	    {
+	      struct vg_ring_entry *entry
+		= &ring->entries[ring->tail % VG_RING_ENTRIES];
+	      /* The ring is shared with the caller: only read the entry
+		 once.  */
+	      ring_entry = *entry;
+
+	      if (VG_ADDR_IS_VOID (ring_entry.target))
+		{
+		  target = (struct vg_object *) thread;
+		  target_writable = true;
+		  err = 0;
+		}
+	      else
+		err = OBJECT_ (&thread->aspace, ring_entry.target, -1, false,
+			       &target, &target_writable);
+
+	      struct vg_object *page = NULL;
+	      if (! err)
+		err = OBJECT_ (&thread->aspace, ring_entry.buffer, vg_cap_page,
+			       true, &page, NULL);
+	      if (! err)
+		{
+		  message = (struct vg_message *) page;
+
+		  label = 0;
+		  if (vg_message_data_count (message) >= sizeof (uintptr_t))
+		    label = vg_message_word (message, 0);
+		  if (! ring_method_p (label))
+		    {
+		      DEBUG (0, "%s may not be submitted using a ring",
+			     method_name (label));
+		      err = EINVAL;
+		    }
+		}
+
+	      if (err)
+		{
+		  entry->status = err;
+		  ring->tail ++;
+		  ring_count ++;
+		  continue;
+		}
+
+	      target_messenger = ring_entry.target;
+	      reply = NULL;
+	      vg_message_clear (reply_buffer);
+	      ring_pending = true;
+	      ring_start = l4_system_clock ();
+	      goto ring_dispatch;
+	    }
+
+	  ring = NULL;
+	  if (ring_reply)
+	    vg_ring_submit_reply (principal, ring_reply, ring_count);
+	}
     }
 
   /* Should never return.  */
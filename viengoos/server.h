@@ -24,4 +24,7 @@
 /* Begin serving requests.  Never returns.  */
 extern void server_loop (void) __attribute__ ((noreturn));
 
+/* Print the number of calls to and the time spent in each method.  */
+extern void server_method_stats_dump (void);
+
 #endif
@@ -0,0 +1,245 @@
+/* superpage.c - Superpage reservations implementation.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include "superpage.h"
+
+#ifdef SUPERPAGES
+
+#include <assert.h>
+#include <viengoos/folio.h>
+
+#include "memory.h"
+#include "pager.h"
+#include "zalloc.h"
+
+struct reservation
+{
+  /* The OID of the first object in the group.  0 if this slot is
+     unused.  (An object's OID is never a multiple of
+     VG_FOLIO_OBJECTS + 1: those are the folios' OIDs.)  */
+  vg_oid_t oid;
+  /* The first frame.  */
+  uintptr_t base;
+  /* The activity on whose behalf the reservation was made.  */
+  struct activity *activity;
+  /* Bit J is set if frame J is in use.  */
+  uint32_t populated;
+};
+
+/* The reservations are kept in a direct-mapped table: creating a
+   reservation breaks any reservation that hashes to the same slot.
+   This bounds the number of unused reserved frames to
+   SUPERPAGE_RESERVATIONS * (SUPERPAGE_OBJECTS - 1).  */
+#define SUPERPAGE_RESERVATIONS 64
+
+static struct reservation reservations[SUPERPAGE_RESERVATIONS];
+
+/* Return the OID of the first object in the group containing the
+   object OID.  */
+static inline vg_oid_t
+group_oid (vg_oid_t oid)
+{
+  int offset = (oid % (VG_FOLIO_OBJECTS + 1)) - 1;
+  assert (offset >= 0);
+
+  return oid - (offset & (SUPERPAGE_OBJECTS - 1));
+}
+
+static inline struct reservation *
+reservation_slot (vg_oid_t group)
+{
+  return &reservations[(group / SUPERPAGE_OBJECTS) % SUPERPAGE_RESERVATIONS];
+}
+
+/* Unmap the objects in the reservation RES from all clients.  */
+static void
+reservation_unmap (struct reservation *res)
+{
+  bool mapped = false;
+  int j;
+  for (j = 0; j < SUPERPAGE_OBJECTS; j ++)
+    if ((res->populated & (1 << j))
+	&& object_to_object_desc ((struct vg_object *)
+				  (res->base + j * PAGESIZE))->mapped)
+      mapped = true;
+
+  if (! mapped)
+    return;
+
+  uintptr_t written = 0;
+  uintptr_t referenced = 0;
+#ifdef USE_L4
+# ifndef _L4_TEST_ENVIRONMENT
+  l4_fpage_t fpage = l4_fpage (res->base, SUPERPAGE_SIZE);
+  fpage = l4_fpage_add_rights (fpage, L4_FPAGE_FULLY_ACCESSIBLE);
+
+  l4_fpage_t result = l4_unmap_fpage (fpage);
+
+  written = l4_was_written (result);
+  referenced = l4_was_referenced (result);
+# endif
+#else
+# warning Unimplemened on this platform.
+#endif
+
+  for (j = 0; j < SUPERPAGE_OBJECTS; j ++)
+    if ((res->populated & (1 << j)))
+      {
+	struct object_desc *desc
+	  = object_to_object_desc ((struct vg_object *)
+				   (res->base + j * PAGESIZE));
+	if (! desc->mapped)
+	  continue;
+
+	/* The status bits are for the whole superpage.  */
+	desc->dirty |= !! written;
+	desc->user_referenced |= !! referenced;
+	desc->user_dirty |= !! written;
+
+	desc->mapped = false;
+      }
+}
+
+/* Break the reservation RES.  Returns the number of frames freed.  */
+static int
+reservation_break (struct reservation *res)
+{
+  assert (res->oid);
+
+  /* Once the reservation is broken, the objects are unmapped one
+     page at a time.  Don't leave a superpage mapping behind.  */
+  reservation_unmap (res);
+
+  int freed = 0;
+  int j;
+  for (j = 0; j < SUPERPAGE_OBJECTS; j ++)
+    {
+      uintptr_t frame = res->base + j * PAGESIZE;
+      if ((res->populated & (1 << j)))
+	object_to_object_desc ((struct vg_object *) frame)->superpage = false;
+      else
+	{
+	  memory_frame_free (frame);
+	  freed ++;
+	}
+    }
+
+  debug (5, "Broke reservation for " VG_OID_FMT " at %p; freed %d frames",
+	 VG_OID_PRINTF (res->oid), (void *) res->base, freed);
+
+  res->oid = 0;
+  return freed;
+}
+
+uintptr_t
+superpage_frame (struct activity *activity, vg_oid_t oid,
+		 enum vg_cap_type type, bool content)
+{
+  if (oid % (VG_FOLIO_OBJECTS + 1) == 0)
+    /* A folio.  */
+    return 0;
+
+  vg_oid_t group = group_oid (oid);
+  int j = oid - group;
+  struct reservation *res = reservation_slot (group);
+
+  if (res->oid == group)
+    {
+      if (res->activity != activity || (res->populated & (1 << j)))
+	{
+	  reservation_break (res);
+	  return 0;
+	}
+
+      res->populated |= 1 << j;
+      return res->base + j * PAGESIZE;
+    }
+
+  if (type != vg_cap_page || content || ! activity)
+    return 0;
+
+  /* Don't hold back frames if memory is tight.  */
+  if (pager_collect_needed ())
+    return 0;
+
+  if (res->oid)
+    reservation_break (res);
+
+  /* As the size is a power of two, the block is naturally aligned.
+     zalloc clears it.  */
+  uintptr_t base = zalloc (SUPERPAGE_SIZE);
+  if (! base)
+    return 0;
+
+  res->oid = group;
+  res->base = base;
+  res->activity = activity;
+  res->populated = 1 << j;
+
+  return base + j * PAGESIZE;
+}
+
+void
+superpage_diverge (struct object_desc *desc)
+{
+  assert (desc->superpage);
+
+  struct reservation *res = reservation_slot (group_oid (desc->oid));
+  assert (res->oid == group_oid (desc->oid));
+
+  reservation_break (res);
+  assert (! desc->superpage);
+}
+
+void
+superpage_unmap (struct object_desc *desc)
+{
+  assert (desc->superpage);
+
+  struct reservation *res = reservation_slot (group_oid (desc->oid));
+  assert (res->oid == group_oid (desc->oid));
+
+  reservation_unmap (res);
+}
+
+uintptr_t
+superpage_base (struct object_desc *desc)
+{
+  if (! desc->superpage)
+    return 0;
+
+  struct reservation *res = reservation_slot (group_oid (desc->oid));
+  assert (res->oid == group_oid (desc->oid));
+
+  return res->base;
+}
+
+int
+superpage_release (int goal)
+{
+  int freed = 0;
+  int i;
+  for (i = 0; i < SUPERPAGE_RESERVATIONS && freed < goal; i ++)
+    if (reservations[i].oid)
+      freed += reservation_break (&reservations[i]);
+
+  return freed;
+}
+
+#endif
@@ -0,0 +1,122 @@
+/* superpage.h - Superpage reservations interface.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef VIENGOOS_SUPERPAGE_H
+#define VIENGOOS_SUPERPAGE_H
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <hurd/stddef.h>
+#include <viengoos/cap.h>
+
+#include "object.h"
+
+/* A folio's objects are divided into groups of SUPERPAGE_OBJECTS
+   consecutive objects.  When the first page of a group is allocated,
+   a naturally aligned block of SUPERPAGE_OBJECTS frames is reserved
+   for the whole group: the object at offset J in the group always
+   uses frame J of the block.  Each object still has its own object
+   descriptor, and is aged, reclaimed and laundered individually.
+
+   If a page fault hits an object in a reservation and the aligned
+   SUPERPAGE_SIZE region of the faulting address space around it
+   designates exactly the reservation's objects, in order, with the
+   same rights, and the objects all belong to the same activity and
+   have the same policy, the region is mapped with a single fpage.
+
+   When an object diverges from the rest of its group (it is claimed
+   by another activity, its policy changes, or it is destroyed), the
+   reservation is broken: the frames that were not yet used are
+   freed and the objects revert to being mapped one page at a time.
+
+   A superpage mapping is made from a single SUPERPAGE_SIZE source
+   fpage.  Rather than rely on L4 revoking part of such a mapping
+   when a single page is unmapped, unmapping any object in a
+   reservation (see object_desc_unmap) unmaps the whole superpage
+   from all clients, as does breaking the reservation.  The other
+   objects are faulted in again when they are next accessed.  As
+   the status bits are only returned for the whole superpage, they
+   are credited to each object that was mapped.
+
+   Superpages are enabled with --enable-superpages.  */
+#define SUPERPAGE_OBJECTS_LOG2 4
+#define SUPERPAGE_OBJECTS (1 << SUPERPAGE_OBJECTS_LOG2)
+#define SUPERPAGE_SIZE_LOG2 (SUPERPAGE_OBJECTS_LOG2 + PAGESIZE_LOG2)
+#define SUPERPAGE_SIZE (1 << SUPERPAGE_SIZE_LOG2)
+
+#ifdef SUPERPAGES
+
+/* Return the frame reserved for the object OID, which is about to be
+   allocated on behalf of ACTIVITY, or 0 if the object should use
+   any frame.  If no reservation covers OID and the object is a page
+   of type TYPE that has no content (CONTENT is false), try to create
+   one.  */
+extern uintptr_t superpage_frame (struct activity *activity, vg_oid_t oid,
+				  enum vg_cap_type type, bool content);
+
+/* The object DESC, which is part of a reservation, no longer matches
+   the rest of its group.  Break the reservation.  */
+extern void superpage_diverge (struct object_desc *desc);
+
+/* DESC is part of a reservation.  Unmap the reservation's objects
+   from all clients and update their status bits.  */
+extern void superpage_unmap (struct object_desc *desc);
+
+/* If DESC is part of a reservation, return the address of its first
+   frame.  Otherwise, return 0.  */
+extern uintptr_t superpage_base (struct object_desc *desc);
+
+/* Break reservations until at least GOAL unused frames have been
+   freed or there are no more reservations.  Returns the number of
+   frames freed.  */
+extern int superpage_release (int goal);
+
+#else
+
+static inline uintptr_t
+superpage_frame (struct activity *activity, vg_oid_t oid,
+		 enum vg_cap_type type, bool content)
+{
+  return 0;
+}
+
+static inline void
+superpage_diverge (struct object_desc *desc)
+{
+}
+
+static inline uintptr_t
+superpage_base (struct object_desc *desc)
+{
+  return 0;
+}
+
+static inline int
+superpage_release (int goal)
+{
+  return 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,202 @@
+#define _L4_TEST_MAIN
+#include "t-environment.h"
+
+#include <hurd/types.h>
+#include <hurd/stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "memory.h"
+#include "cap.h"
+#include "object.h"
+#include "activity.h"
+#include "backing-store.h"
+
+struct activity *root_activity;
+
+#define STORE "t-backing-store.store"
+
+extern char _start;
+extern char _end;
+
+void
+test (void)
+{
+  if (! memory_reserve ((l4_word_t) &_start, (l4_word_t) &_end,
+			memory_reservation_self))
+    panic ("Failed to reserve memory for self.");
+
+  memory_grab ();
+  object_init ();
+
+  if (! backing_store_init ("file," STORE))
+    panic ("Failed to initialize the backing store.");
+
+  /* Create the root activity.  */
+  struct vg_folio *folio = folio_alloc (NULL, VG_FOLIO_POLICY_DEFAULT);
+  if (! folio)
+    panic ("Failed to allocate storage for the initial task!");
+
+  struct vg_cap c = folio_object_alloc (NULL, folio, 0,
+					vg_cap_activity_control,
+					VG_OBJECT_POLICY_DEFAULT, 0);
+  root_activity = (struct activity *) vg_cap_to_object (root_activity, &c);
+  folio_parent (root_activity, folio);
+
+  /* Allocate a folio full of pages and fill each with a unique
+     pattern.  */
+  struct vg_folio *f = folio_alloc (root_activity, VG_FOLIO_POLICY_DEFAULT);
+  assert (f);
+
+  struct vg_cap caps[VG_FOLIO_OBJECTS];
+  struct object_desc *descs[VG_FOLIO_OBJECTS];
+  int i;
+  for (i = 0; i < VG_FOLIO_OBJECTS; i ++)
+    {
+      caps[i] = folio_object_alloc (root_activity, f, i, vg_cap_page,
+				    VG_OBJECT_POLICY_DEFAULT, 0);
+      struct vg_object *page = vg_cap_to_object (root_activity, &caps[i]);
+      assert (page);
+
+      memset (page, i + 1, PAGESIZE);
+      descs[i] = object_to_object_desc (page);
+    }
+
+  /* Write them out in a single batch.  */
+  error_t err = backing_store_write (f, VG_FOLIO_OBJECTS, descs);
+  check ("write", "folio batch written", err == 0, "err: %d", err);
+
+  for (i = 0; i < VG_FOLIO_OBJECTS; i ++)
+    check ("write", "content recorded", folio_object_content (f, i),
+	   "object %d", i);
+
+  /* Evict them.  */
+  for (i = 0; i < VG_FOLIO_OBJECTS; i ++)
+    {
+      struct vg_object *page = object_desc_to_object (descs[i]);
+      memory_object_destroy (root_activity, page);
+      memory_frame_free ((l4_word_t) page);
+
+      check ("evict", "object no longer in memory",
+	     ! cap_to_object_soft (root_activity, &caps[i]),
+	     "object %d", i);
+    }
+
+  /* And read them back in.  */
+  for (i = 0; i < VG_FOLIO_OBJECTS; i ++)
+    {
+      unsigned char *page
+	= (unsigned char *) vg_cap_to_object (root_activity, &caps[i]);
+      check ("read", "object paged in", page, "object %d", i);
+
+      int j;
+      for (j = 0; j < PAGESIZE; j ++)
+	if (page[j] != i + 1)
+	  break;
+      check ("read", "content preserved", j == PAGESIZE,
+	     "object %d, byte %d: %d != %d", i, j, page[j], i + 1);
+    }
+
+  /* Launder a few objects and modify one of them while it is being
+     written: it must remain dirty and on the laundry.  */
+  for (i = 0; i < 4; i ++)
+    {
+      struct vg_object *page = vg_cap_to_object (root_activity, &caps[i]);
+      descs[i] = object_to_object_desc (page);
+      descs[i]->dirty = true;
+      laundry_list_enqueue (&laundry, descs[i]);
+    }
+
+  static struct backing_store_batch batch;
+  int count = backing_store_batch_fill (&batch, 4);
+  check ("launder", "batch filled", count == 4, "count: %d", count);
+  for (i = 1; i < count; i ++)
+    check ("launder", "batch sorted", batch.oids[i - 1] < batch.oids[i],
+	   "%d", i);
+
+  backing_store_batch_write (&batch);
+  memset (object_desc_to_object (descs[2]), 0xaa, PAGESIZE);
+  count = backing_store_batch_commit (&batch);
+  check ("launder", "unmodified objects cleaned", count == 3,
+	 "count: %d", count);
+
+  for (i = 0; i < 4; i ++)
+    {
+      bool stale = i == 2;
+      check ("launder", "dirty bit", descs[i]->dirty == stale,
+	     "object %d", i);
+      check ("launder", "laundry",
+	     list_node_attached (&descs[i]->laundry_node) == stale,
+	     "object %d", i);
+      check ("launder", "content", folio_object_content (f, i) != stale,
+	     "object %d", i);
+    }
+  laundry_list_unlink (&laundry, descs[2]);
+  descs[2]->dirty = false;
+  memset (object_desc_to_object (descs[2]), 3, PAGESIZE);
+
+  /* Claim an object while it is being written.  It must not be
+     written again until the first write has been committed: the
+     writes could otherwise land in either order.  */
+  for (i = 4; i < 8; i ++)
+    {
+      struct vg_object *page = vg_cap_to_object (root_activity, &caps[i]);
+      descs[i] = object_to_object_desc (page);
+      descs[i]->dirty = true;
+      laundry_list_enqueue (&laundry, descs[i]);
+    }
+
+  count = backing_store_batch_fill (&batch, 4);
+  check ("in flight", "batch filled", count == 4, "count: %d", count);
+
+  object_desc_claim (root_activity, descs[5], descs[5]->policy, true);
+  memset (object_desc_to_object (descs[5]), 0x55, PAGESIZE);
+
+  count = backing_store_launder (4);
+  check ("in flight", "in-flight objects skipped", count == 0,
+	 "count: %d", count);
+
+  backing_store_batch_write (&batch);
+  count = backing_store_batch_commit (&batch);
+  check ("in flight", "claimed object not cleaned", count == 3,
+	 "count: %d", count);
+  check ("in flight", "claimed object dirty", descs[5]->dirty, "");
+
+  count = backing_store_launder (4);
+  check ("in flight", "claimed object cleaned after commit", count == 1,
+	 "count: %d", count);
+  check ("in flight", "content", folio_object_content (f, 5), "");
+
+  struct vg_object *page = object_desc_to_object (descs[5]);
+  memory_object_destroy (root_activity, page);
+  memory_frame_free ((l4_word_t) page);
+
+  unsigned char *p = (unsigned char *) vg_cap_to_object (root_activity,
+							 &caps[5]);
+  check ("in flight", "object paged in", p, "");
+  for (i = 0; i < PAGESIZE; i ++)
+    if (p[i] != 0x55)
+      break;
+  check ("in flight", "latest content read back", i == PAGESIZE,
+	 "byte %d: %d", i, p[i]);
+
+  /* Corrupt an object on backing store and make sure that the
+     checksum catches it.  */
+  page = vg_cap_to_object (root_activity, &caps[0]);
+  descs[0] = object_to_object_desc (page);
+  err = backing_store_write (f, 1, descs);
+  assert (! err);
+  memory_object_destroy (root_activity, page);
+  memory_frame_free ((l4_word_t) page);
+
+  int fd = open (STORE, O_WRONLY);
+  assert (fd >= 0);
+  char garbage = 0xff;
+  pwrite (fd, &garbage, 1, (off_t) caps[0].oid * PAGESIZE + 17);
+  close (fd);
+
+  check ("checksum", "corrupted object rejected",
+	 ! vg_cap_to_object (root_activity, &caps[0]), "");
+
+  unlink (STORE);
+}
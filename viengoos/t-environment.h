@@ -283,6 +283,36 @@ pager_collect (void)
 {
 }
 
+void
+pager_wake (int goal)
+{
+}
+
+#ifndef T_ENVIRONMENT_FUTEX
+/* Tests that exercise the futexes define T_ENVIRONMENT_FUTEX and link
+   in futex.c.  */
+struct messenger;
+void
+futex_unlink (struct messenger *messenger)
+{
+}
+#endif
+
+void
+server_method_stats_dump (void)
+{
+}
+
+#ifndef T_ENVIRONMENT_TIMER
+/* Tests that exercise the timers define T_ENVIRONMENT_TIMER and link
+   in timer.c.  */
+struct timer;
+void
+timer_cancel (struct timer *timer)
+{
+}
+#endif
+
 #include "output.h"
 
 void test (void);
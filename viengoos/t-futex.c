@@ -0,0 +1,177 @@
+#define _L4_TEST_MAIN
+#define T_ENVIRONMENT_FUTEX
+#include "t-environment.h"
+
+#include <string.h>
+#include <limits.h>
+#include <hurd/stddef.h>
+
+#include "futex.h"
+
+int output_debug = 0;
+
+/* Exercise futex_wake: waking, requeuing onto another futex and
+   requeuing onto the same futex.  The object layer is replaced by
+   stubs: the futexes live in two pages with their own descriptors
+   and a woken messenger is recorded rather than sent a reply.  */
+
+#define PAGES 2
+#define MESSENGERS 8
+
+static char pages[PAGES * PAGESIZE] __attribute__ ((aligned (PAGESIZE)));
+static struct object_desc descs[PAGES];
+static int section_index[1];
+
+l4_word_t first_frame;
+l4_word_t last_frame;
+int *object_desc_section_index = section_index;
+struct object_desc *object_descs = descs;
+
+struct futex_waiter_list futex_waiters;
+
+static struct messenger messengers[MESSENGERS];
+
+/* The messengers that were woken, in order.  */
+static struct messenger *woken[MESSENGERS];
+static int woken_count;
+
+static char reply_data[PAGESIZE];
+struct vg_message *reply_buffer = (struct vg_message *) reply_data;
+
+void
+reply_buffer_pin (void)
+{
+}
+
+bool
+messenger_message_load (struct activity *activity,
+			struct messenger *target,
+			struct vg_message *message)
+{
+  assert (woken_count < MESSENGERS);
+  woken[woken_count ++] = target;
+  return true;
+}
+
+void
+messenger_timeout (struct messenger *messenger, uint64_t deadline)
+{
+}
+
+void
+object_wait_queue_enqueue (struct activity *activity,
+			   struct vg_object *object, struct messenger *messenger)
+{
+  assert (! messenger->wait_queue_p);
+  messenger->wait_queue_p = true;
+}
+
+void
+object_wait_queue_unlink (struct activity *activity,
+			  struct messenger *messenger)
+{
+  assert (messenger->wait_queue_p);
+  messenger->wait_queue_p = false;
+
+  if (messenger->wait_reason == MESSENGER_WAIT_FUTEX)
+    {
+      futex_unlink (messenger);
+#ifndef NDEBUG
+      futex_waiter_list_unlink (&futex_waiters, messenger);
+#endif
+    }
+}
+
+static struct vg_object *
+page (int i)
+{
+  return (struct vg_object *) &pages[i * PAGESIZE];
+}
+
+/* Have messengers FIRST to LAST - 1 wait on the futex at OFFSET in
+   page P.  */
+static void
+wait (int first, int last, int p, int offset)
+{
+  int i;
+  for (i = first; i < last; i ++)
+    {
+      error_t err = futex_wait (NULL, page (p), offset, NULL,
+				&messengers[i]);
+      assert (! err);
+    }
+}
+
+/* Wake all of the messengers waiting on the futex at OFFSET in page P
+   and check that they are messengers FIRST to LAST - 1, in that
+   order.  */
+static void
+wake_all (const char *phase, int p, int offset, int first, int last)
+{
+  woken_count = 0;
+  int count = futex_wake (NULL, INT_MAX, page (p), offset, 0, NULL, 0);
+  check_nr (phase, "woken", count, last - first);
+  check_nr (phase, "replies", woken_count, last - first);
+
+  int i;
+  for (i = 0; i < woken_count && first + i < last; i ++)
+    check (phase, "wake order", woken[i] == &messengers[first + i],
+	   "%d: messenger %d", i, (int) (woken[i] - messengers));
+}
+
+void
+test (void)
+{
+  first_frame = (l4_word_t) pages;
+  last_frame = (l4_word_t) page (PAGES - 1);
+
+  int i;
+  for (i = 0; i < PAGES; i ++)
+    descs[i].oid = 1 + i;
+
+  futex_waiter_list_init (&futex_waiters, "futex_waiters");
+
+  /* Wake one, requeue the rest onto another futex.  Messengers
+     waiting on a different futex in the same page are not
+     touched.  */
+  wait (0, 6, 0, 0);
+  wait (6, MESSENGERS, 0, 4);
+
+  woken_count = 0;
+  int count = futex_wake (NULL, 1, page (0), 0, INT_MAX, page (1), 8);
+  check_nr ("requeue", "woken and requeued", count, 6);
+  check_nr ("requeue", "replies", woken_count, 1);
+  check ("requeue", "first waiter woken", woken[0] == &messengers[0], "");
+
+  wake_all ("requeue", 0, 0, 0, 0);
+  wake_all ("requeue", 1, 8, 1, 6);
+  wake_all ("requeue", 0, 4, 6, MESSENGERS);
+
+  /* Requeue onto the same futex.  Each waiter must be visited once
+     and remain queued once, in order.  */
+  wait (0, MESSENGERS, 0, 0);
+
+  woken_count = 0;
+  count = futex_wake (NULL, 2, page (0), 0, INT_MAX, page (0), 0);
+  check_nr ("same futex", "woken and requeued", count, MESSENGERS);
+  check_nr ("same futex", "replies", woken_count, 2);
+
+  wake_all ("same futex", 0, 0, 2, MESSENGERS);
+  wake_all ("same futex", 0, 0, 0, 0);
+
+  /* Requeue only some of the waiters onto the same futex: they go to
+     the back of the queue.  */
+  wait (0, MESSENGERS, 0, 0);
+
+  woken_count = 0;
+  count = futex_wake (NULL, 0, page (0), 0, 3, page (0), 0);
+  check_nr ("same futex, partial", "requeued", count, 3);
+  check_nr ("same futex, partial", "replies", woken_count, 0);
+
+  count = futex_wake (NULL, INT_MAX, page (0), 0, 0, NULL, 0);
+  check_nr ("same futex, partial", "woken", count, MESSENGERS);
+  for (i = 0; i < woken_count; i ++)
+    check ("same futex, partial", "wake order",
+	   woken[i] == &messengers[(i + 3) % MESSENGERS],
+	   "%d: messenger %d", i, (int) (woken[i] - messengers));
+}
@@ -0,0 +1,289 @@
+#define _L4_TEST_MAIN
+#include "t-environment.h"
+
+#include <string.h>
+#include <hurd/stddef.h>
+
+#include "object.h"
+#include "replacement.h"
+
+int output_debug = 0;
+
+/* Replay a reference trace against each replacement policy and
+   report the fault rate.
+
+   The trace is read from the file named by the environment variable
+   REPLACEMENT_TRACE, if set.  It consists of white space separated
+   object numbers, each less than OBJECTS.  Otherwise, two synthetic
+   traces are used: a Zipf-distributed trace and a trace that mixes a
+   shifting working set with a sequential scan.
+
+   The simulation mirrors the kernel: a fault claims a frame (as
+   object_desc_claim) and, if all FRAMES frames are in use, first
+   reclaims one as reclaim_from does.  Every PERIOD references, the
+   objects are aged as ager_loop does.  */
+
+#define OBJECTS 1024
+#define FRAMES 256
+#define PERIOD 256
+
+/* The maximum length of a trace.  */
+#define REFERENCES_MAX (1024 * 1024)
+/* The length of the synthetic traces.  */
+#define REFERENCES 60000
+
+/* The size of the working set in the scan trace.  */
+#define SCAN_HOT 128
+/* The number of references after which the working set changes.  */
+#define SCAN_PHASE 8192
+
+static int trace[REFERENCES_MAX];
+static int references;
+
+static struct object_desc descs[OBJECTS];
+static bool resident[OBJECTS];
+static bool referenced[OBJECTS];
+
+static void
+trace_load (const char *file)
+{
+  FILE *f = fopen (file, "r");
+  check ("trace", "trace file opened", f, "%s", file);
+
+  int object;
+  while (references < REFERENCES_MAX && fscanf (f, "%d", &object) == 1)
+    {
+      check ("trace", "object in range", 0 <= object && object < OBJECTS,
+	     "reference %d: %d", references, object);
+      trace[references ++] = object;
+    }
+
+  fclose (f);
+}
+
+/* Generate a trace in which the probability of referencing object I
+   is proportional to 1 / (I + 1).  */
+static void
+trace_zipf (void)
+{
+  static double cdf[OBJECTS];
+  double sum = 0;
+  int i;
+  for (i = 0; i < OBJECTS; i ++)
+    {
+      sum += 1.0 / (i + 1);
+      cdf[i] = sum;
+    }
+
+  /* A linear congruential generator so that the trace is the same on
+     every run.  */
+  uint32_t seed = 1;
+
+  for (references = 0; references < REFERENCES; references ++)
+    {
+      seed = seed * 1103515245 + 12345;
+      double r = (double) (seed >> 8) / (1 << 24) * sum;
+
+      int lo = 0;
+      int hi = OBJECTS - 1;
+      while (lo < hi)
+	{
+	  int mid = (lo + hi) / 2;
+	  if (cdf[mid] < r)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+
+      trace[references] = lo;
+    }
+}
+
+/* Generate a trace in which every second reference is to the next
+   object of a sequential scan over the objects that are not in the
+   working set.  The other references are to random objects in the
+   working set, which alternates between two disjoint sets of SCAN_HOT
+   objects every SCAN_PHASE references.  The working set fits in
+   memory, the scan does not.  */
+static void
+trace_scan (void)
+{
+  uint32_t seed = 1;
+  int next = 0;
+
+  for (references = 0; references < REFERENCES; references ++)
+    {
+      seed = seed * 1103515245 + 12345;
+      if ((seed >> 16) % 2 == 0)
+	{
+	  trace[references] = 2 * SCAN_HOT + next;
+	  next = (next + 1) % (OBJECTS - 2 * SCAN_HOT);
+	}
+      else
+	{
+	  int set = (references / SCAN_PHASE) % 2;
+	  trace[references] = set * SCAN_HOT + (seed >> 8) % SCAN_HOT;
+	}
+    }
+}
+
+/* As ager_loop.  */
+static void
+age (struct activity_list *active, struct activity_list *inactive)
+{
+  int i;
+  for (i = 0; i < OBJECTS; i ++)
+    {
+      if (! resident[i])
+	continue;
+
+      struct object_desc *desc = &descs[i];
+      bool r = referenced[i];
+      referenced[i] = false;
+
+      if (object_active (desc))
+	{
+	  object_age (desc, r);
+	  if (! object_active (desc))
+	    {
+	      activity_list_unlink (active, desc);
+	      activity_list_enqueue (inactive, desc);
+	    }
+	}
+      else
+	{
+	  object_age (desc, r);
+	  if (r)
+	    {
+	      activity_list_unlink (inactive, desc);
+	      activity_list_enqueue (active, desc);
+	    }
+	}
+    }
+}
+
+/* Replay the trace using SELECT to choose active objects to evict.
+   Returns the number of faults.  */
+static int
+replay (struct object_desc *(*select) (struct activity_list *))
+{
+  struct activity_list active;
+  struct activity_list inactive;
+  activity_list_init (&active, "active");
+  activity_list_init (&inactive, "inactive");
+
+  memset (descs, 0, sizeof (descs));
+  memset (resident, 0, sizeof (resident));
+  memset (referenced, 0, sizeof (referenced));
+
+  int frames = 0;
+  int faults = 0;
+
+  int i;
+  for (i = 0; i < references; i ++)
+    {
+      if (i % PERIOD == 0)
+	age (&active, &inactive);
+
+      int object = trace[i];
+      if (resident[object])
+	{
+	  referenced[object] = true;
+	  continue;
+	}
+
+      faults ++;
+
+      if (frames == FRAMES)
+	{
+	  struct object_desc *victim = activity_list_dequeue (&inactive);
+	  if (! victim)
+	    victim = select (&active);
+	  assert (victim);
+
+	  resident[victim - descs] = false;
+	  frames --;
+	}
+
+      /* As object_desc_claim.  */
+      struct object_desc *desc = &descs[object];
+      desc->age = 0;
+      object_age (desc, true);
+      activity_list_push (&active, desc);
+
+      resident[object] = true;
+      /* The faulting access.  */
+      referenced[object] = true;
+      frames ++;
+    }
+
+  return faults;
+}
+
+static struct
+{
+  const char *name;
+  struct object_desc *(*select) (struct activity_list *);
+  int faults;
+} policies[] =
+  {
+    { "fifo", replacement_select_fifo },
+    { "once", replacement_select_once },
+    { "aging", replacement_select_aging },
+  };
+
+#define FIFO 0
+#define ONCE 1
+
+/* Replay the current trace, which is called NAME, against each
+   policy.  */
+static void
+replay_policies (const char *name)
+{
+  check ("trace", "trace not empty", references > 0, "%s", name);
+
+  int i;
+  for (i = 0; i < sizeof (policies) / sizeof (policies[0]); i ++)
+    {
+      policies[i].faults = replay (policies[i].select);
+
+      int rate = (int) ((long long) policies[i].faults * 10000 / references);
+      printf ("%s: %s: %d references, %d frames, %d faults (%d.%02d%%)\n",
+	      name, policies[i].name, references, FRAMES, policies[i].faults,
+	      rate / 100, rate % 100);
+    }
+}
+
+void
+test (void)
+{
+  const char *file = getenv ("REPLACEMENT_TRACE");
+  if (file)
+    {
+      trace_load (file);
+      replay_policies (file);
+      return;
+    }
+
+  trace_zipf ();
+  replay_policies ("zipf");
+
+  /* On a skewed trace, the most recently claimed object is usually
+     one that is rarely used.  once must do at least about as well as
+     evicting it.  */
+  check ("replay", "zipf fault rate",
+	 policies[ONCE].faults * 100 <= policies[FIFO].faults * 102,
+	 "once: %d faults, fifo: %d faults",
+	 policies[ONCE].faults, policies[FIFO].faults);
+
+  trace_scan ();
+  replay_policies ("scan");
+
+  /* fifo does not let a scan flush the working set either, but it
+     holds on to an old working set until the ager deactivates it.
+     once must do significantly better.  */
+  check ("replay", "scan fault rate",
+	 policies[ONCE].faults * 100 <= policies[FIFO].faults * 90,
+	 "once: %d faults, fifo: %d faults",
+	 policies[ONCE].faults, policies[FIFO].faults);
+}
@@ -0,0 +1,233 @@
+#define _L4_TEST_MAIN
+#define T_ENVIRONMENT_TIMER
+#include "t-environment.h"
+
+#include <string.h>
+#include <hurd/stddef.h>
+
+#include "timer.h"
+
+int output_debug = 0;
+
+/* Exercise the timer wheel: timers on every level and beyond the
+   wheel's range are inserted, cascaded and expired, both when the
+   clock is advanced to the time returned by timers_next, as the
+   server thread does, and when it is advanced a tick at a time.  */
+
+/* The clock used by timer.c in the test environment.  */
+extern uint64_t timer_test_clock;
+
+#define TICK (1ULL << TIMER_TICK_LOG2)
+
+/* The number of ticks covered by level LEVEL.  */
+#define LEVEL_RANGE(level) (1ULL << (TIMER_SLOTS_LOG2 * ((level) + 1)))
+
+#define N 500
+
+static struct timer timers[N];
+/* When each timer expired, or 0 if it has not.  */
+static uint64_t expired[N];
+/* The number of timers that expired.  */
+static int expired_count;
+/* The deadline tick of the last timer that expired.  Timers must
+   expire in order.  */
+static uint64_t expired_last;
+
+static const char *phase;
+
+static uint32_t seed = 1;
+
+static uint32_t
+rand_next (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static uint64_t
+rand_range (uint64_t limit)
+{
+  return (((uint64_t) rand_next () << 24) | rand_next ()) % limit;
+}
+
+static void
+expire (struct timer *timer)
+{
+  int i = timer - timers;
+
+  check (phase, "expires once", ! expired[i],
+	 "timer %d expired twice", i);
+  check (phase, "not early", timer->deadline <= timer_test_clock,
+	 "timer %d: deadline %llx, now %llx", i,
+	 (long long) timer->deadline, (long long) timer_test_clock);
+  check (phase, "in order",
+	 (timer->deadline >> TIMER_TICK_LOG2) >= expired_last,
+	 "timer %d: deadline tick %llx, last %llx", i,
+	 (long long) (timer->deadline >> TIMER_TICK_LOG2),
+	 (long long) expired_last);
+
+  expired[i] = timer_test_clock;
+  expired_count ++;
+  expired_last = timer->deadline >> TIMER_TICK_LOG2;
+}
+
+static void
+reset (const char *p)
+{
+  phase = p;
+  memset (expired, 0, sizeof (expired));
+  expired_count = 0;
+  expired_last = 0;
+}
+
+/* Add timer I with a deadline on a random level (or beyond the
+   wheel's range), relative to the current time.  */
+static void
+add_random (int i)
+{
+  int level = rand_next () % (TIMER_LEVELS + 1);
+  uint64_t range;
+  if (level < TIMER_LEVELS)
+    range = LEVEL_RANGE (level);
+  else
+    range = 2 * LEVEL_RANGE (TIMER_LEVELS - 1);
+  timer_add (&timers[i], timer_test_clock + rand_range (range * TICK),
+	     expire);
+}
+
+/* Check that timer I expired at most two ticks late.  */
+static void
+check_late (int i)
+{
+  check (phase, "expired", expired[i], "timer %d did not expire", i);
+  check (phase, "not late", expired[i] - timers[i].deadline <= 2 * TICK,
+	 "timer %d: deadline %llx, expired %llx", i,
+	 (long long) timers[i].deadline, (long long) expired[i]);
+}
+
+/* Return the earliest deadline of a pending timer.  */
+static uint64_t
+earliest (void)
+{
+  uint64_t e = -1ULL;
+  int i;
+  for (i = 0; i < N; i ++)
+    if (timer_pending (&timers[i]) && timers[i].deadline < e)
+      e = timers[i].deadline;
+  return e;
+}
+
+/* Advance the clock to the time returned by timers_next until no
+   timers are left.  Returns the number of calls to timers_run.  */
+static int
+run_to_next (void)
+{
+  int runs = 0;
+  uint64_t next;
+  while ((next = timers_next ()))
+    {
+      check (phase, "next in future", next > timer_test_clock,
+	     "next %llx, now %llx",
+	     (long long) next, (long long) timer_test_clock);
+      uint64_t e = earliest ();
+      check (phase, "next not after earliest", next <= e + 2 * TICK,
+	     "next %llx, earliest deadline %llx",
+	     (long long) next, (long long) e);
+
+      timer_test_clock = next;
+      timers_run ();
+      runs ++;
+    }
+
+  return runs;
+}
+
+static int periodic_count;
+
+static void
+periodic (struct timer *timer)
+{
+  expire (timer);
+  periodic_count ++;
+
+  if (periodic_count < 50)
+    {
+      expired[timer - timers] = 0;
+      timer_add (timer, timer->deadline + 100 * TICK + 17, periodic);
+    }
+}
+
+void
+test (void)
+{
+  /* Start at an odd time so that the slot indexes are not all
+     zero.  */
+  timer_test_clock = 0x123456789abULL;
+
+  int i;
+
+  /* Insert timers on each level and beyond the wheel's range and
+     follow timers_next.  Only the ticks at which a timer expires or
+     a slot is moved down need to be processed: each timer is moved
+     down at most once per level and perhaps once more if it is beyond
+     the wheel's range.  */
+  reset ("next");
+  for (i = 0; i < N; i ++)
+    add_random (i);
+
+  int runs = run_to_next ();
+  check_nr (phase, "all expired", expired_count, N);
+  for (i = 0; i < N; i ++)
+    check_late (i);
+  check (phase, "ticks skipped", runs <= N * (TIMER_LEVELS + 1),
+	 "%d runs for %d timers", runs, N);
+
+  /* Advance the clock a tick at a time.  Cancel every third timer
+     along the way and keep a periodic timer going.  */
+  reset ("step");
+  for (i = 0; i < N - 1; i ++)
+    timer_add (&timers[i],
+	       timer_test_clock + rand_range (LEVEL_RANGE (2) * TICK / 16),
+	       expire);
+  periodic_count = 0;
+  timer_add (&timers[N - 1], timer_test_clock + 10 * TICK, periodic);
+
+  uint64_t end = timer_test_clock + LEVEL_RANGE (2) * TICK / 8;
+  while (timer_test_clock < end)
+    {
+      timer_test_clock += TICK;
+
+      for (i = 0; i < N - 1; i += 3)
+	if (timer_pending (&timers[i])
+	    && timers[i].deadline < timer_test_clock + 4 * TICK)
+	  timer_cancel (&timers[i]);
+
+      int count = expired_count;
+      int ran = timers_run ();
+      check_nr (phase, "timers run", ran, expired_count - count);
+    }
+  check (phase, "all done", ! timers_next (), "timers pending");
+
+  for (i = 0; i < N - 1; i ++)
+    if (i % 3 == 0)
+      check (phase, "cancelled", ! expired[i],
+	     "cancelled timer %d expired", i);
+    else
+      check_late (i);
+  check_nr (phase, "periodic", periodic_count, 50);
+
+  /* Jump past all of the deadlines at once.  */
+  reset ("jump");
+  for (i = 0; i < N; i ++)
+    add_random (i);
+
+  uint64_t last = 0;
+  for (i = 0; i < N; i ++)
+    if (timers[i].deadline > last)
+      last = timers[i].deadline;
+  timer_test_clock = last + TICK;
+
+  check_nr (phase, "timers run", timers_run (), N);
+  check_nr (phase, "all expired", expired_count, N);
+  check (phase, "none left", ! timers_next (), "timers pending");
+}
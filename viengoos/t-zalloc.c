@@ -0,0 +1,178 @@
+#define _L4_TEST_MAIN
+#include "t-environment.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <hurd/stddef.h>
+
+#include "zalloc.h"
+
+int output_debug = 0;
+
+/* Replay a random trace of allocations and frees against zalloc and
+   report the throughput and the fragmentation.  This program is built
+   once for each zone engine (t-zalloc-list and t-zalloc-bitmap) so
+   that their numbers can be compared.
+
+   Most requests are for a single page; the rest are for 2 to 32
+   pages.  The trace is generated with a linear congruential generator
+   so that it is the same on every run and for every engine.  */
+
+#if ZALLOC_ENGINE == ZALLOC_LIST
+# define ENGINE "list"
+#elif ZALLOC_ENGINE == ZALLOC_BITMAP
+# define ENGINE "bitmap"
+#endif
+
+/* The size of the pool in pages.  */
+#define PAGES (16 * 1024)
+/* The number of operations.  */
+#define OPERATIONS (1000 * 1000)
+/* Sample the fragmentation every SAMPLE operations.  */
+#define SAMPLE 1000
+
+static uint32_t seed = 1;
+
+static uint32_t
+rand_next (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+static int
+size_next (void)
+{
+  int r = rand_next () % 100;
+  if (r < 75)
+    return 1;
+  if (r < 85)
+    return 2;
+  if (r < 92)
+    return 4;
+  if (r < 96)
+    return 8;
+  if (r < 98)
+    return 3;
+  return 16 + rand_next () % 17;
+}
+
+static struct
+{
+  uintptr_t addr;
+  int pages;
+} allocs[PAGES];
+static int alloc_count;
+
+/* Which pages are allocated.  */
+static bool owned[PAGES];
+
+static char *pool;
+
+static void
+own (uintptr_t addr, int pages, bool value)
+{
+  int first = (addr - (uintptr_t) pool) / PAGESIZE;
+  int i;
+  for (i = first; i < first + pages; i ++)
+    {
+      check ("own", "page in pool", 0 <= i && i < PAGES,
+	     "%p (%d pages)", (void *) addr, pages);
+      check ("own", "page ownership", owned[i] != value,
+	     "page %d (%p, %d pages) is %s allocated",
+	     i, (void *) addr, pages, value ? "already" : "not");
+      owned[i] = value;
+    }
+}
+
+void
+test (void)
+{
+  /* Align the pool to its size so that it coalesces into a single
+     block.  */
+  if (posix_memalign ((void **) &pool, PAGES * PAGESIZE, PAGES * PAGESIZE))
+    panic ("Failed to allocate pool");
+
+  zfree ((uintptr_t) pool, PAGES * PAGESIZE);
+  check_nr ("init", "available memory", zalloc_memory, (uintptr_t) PAGES);
+
+  int allocated = 0;
+  int failures = 0;
+  int fragmentation = 0;
+  int samples = 0;
+
+  clock_t start = clock ();
+
+  int i;
+  for (i = 0; i < OPERATIONS; i ++)
+    {
+      /* Keep about three quarters of the pool in use.  */
+      bool alloc = alloc_count == 0
+	|| (rand_next () % PAGES) >= allocated * 2 / 3;
+
+      if (alloc && alloc_count < PAGES)
+	{
+	  int pages = size_next ();
+	  uintptr_t addr = zalloc (pages * PAGESIZE);
+	  if (! addr)
+	    failures ++;
+	  else
+	    {
+	      allocs[alloc_count].addr = addr;
+	      allocs[alloc_count].pages = pages;
+	      alloc_count ++;
+	      allocated += pages;
+	    }
+	}
+      else
+	{
+	  int j = rand_next () % alloc_count;
+	  zfree (allocs[j].addr, allocs[j].pages * PAGESIZE);
+	  allocated -= allocs[j].pages;
+	  allocs[j] = allocs[-- alloc_count];
+	}
+
+      if (i % SAMPLE == 0)
+	{
+	  fragmentation += zalloc_fragmentation ();
+	  samples ++;
+	}
+    }
+
+  clock_t end = clock ();
+
+  long long us = (long long) (end - start) * 1000000 / CLOCKS_PER_SEC;
+  printf (ENGINE ": %d operations in %lld us (%lld ops/ms); "
+	  "%d failed allocations; %d%% average fragmentation\n",
+	  OPERATIONS, us, us ? (long long) OPERATIONS * 1000 / us : 0,
+	  failures, fragmentation / samples);
+
+  /* Verify that no page was handed out twice.  */
+  for (i = 0; i < alloc_count; i ++)
+    own (allocs[i].addr, allocs[i].pages, true);
+  check_nr ("replay", "available memory",
+	    zalloc_memory, (uintptr_t) (PAGES - allocated));
+
+  /* Free everything.  */
+  for (i = 0; i < alloc_count; i ++)
+    {
+      own (allocs[i].addr, allocs[i].pages, false);
+      zfree (allocs[i].addr, allocs[i].pages * PAGESIZE);
+    }
+  check_nr ("drain", "available memory", zalloc_memory, (uintptr_t) PAGES);
+
+  /* Everything should coalesce back into a single block.  */
+  uintptr_t addr = zalloc (PAGES * PAGESIZE);
+  check ("drain", "coalesced", addr == (uintptr_t) pool,
+	 "%p != %p", (void *) addr, pool);
+  check_nr ("drain", "available memory", zalloc_memory, (uintptr_t) 0);
+
+  /* Free a lone page and a larger block.  Refilling the magazine must
+     use the lone page rather than split the larger block.  */
+  zfree (addr + 5 * PAGESIZE, 3 * PAGESIZE);
+  zfree (addr + 32 * PAGESIZE, 32 * PAGESIZE);
+  uintptr_t page = zalloc (PAGESIZE);
+  check ("refill", "lone page used first",
+	 page == addr + 5 * PAGESIZE, "%p", (void *) page);
+}
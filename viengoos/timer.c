@@ -0,0 +1,241 @@
+/* timer.c - Kernel timer implementation.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <l4.h>
+#include <assert.h>
+#include <viengoos/math.h>
+
+#include "timer.h"
+#include "output.h"
+
+#if TIMER_SLOTS > 64
+# error The slot bitmaps have room for at most 64 slots per level.
+#endif
+
+#ifndef _L4_TEST_ENVIRONMENT
+# define timer_clock() l4_system_clock ()
+#else
+/* The tests set the time.  */
+uint64_t timer_test_clock;
+# define timer_clock() timer_test_clock
+#endif
+
+static struct timer_list timer_wheel[TIMER_LEVELS][TIMER_SLOTS];
+
+/* For each level, a bitmap of the slots that are not empty.  */
+static uint64_t timer_occupied[TIMER_LEVELS];
+
+/* The number of pending timers.  */
+static int timer_count;
+
+/* The next tick to process.  Only meaningful if TIMER_COUNT is not
+   zero.  */
+static uint64_t timer_tick;
+
+/* The number of ticks covered by a slot on level LEVEL, log2.  */
+#define LEVEL_SHIFT(level) (TIMER_SLOTS_LOG2 * (level))
+
+/* Clear SLOT's bit in its level's bitmap if SLOT is empty.  */
+static void
+timer_slot_update (struct timer_list *slot)
+{
+  if (timer_list_head (slot))
+    return;
+
+  int i = slot - &timer_wheel[0][0];
+  if (i < 0 || i >= TIMER_LEVELS * TIMER_SLOTS)
+    /* Not a slot, e.g., the list of expired timers in timers_run.  */
+    return;
+
+  timer_occupied[i / TIMER_SLOTS] &= ~(1ULL << (i % TIMER_SLOTS));
+}
+
+/* Place TIMER on the wheel according to its deadline.  */
+static void
+timer_insert (struct timer *timer)
+{
+  uint64_t tick = timer->deadline >> TIMER_TICK_LOG2;
+  if (tick < timer_tick)
+    /* Already expired.  Run it at the next tick.  */
+    tick = timer_tick;
+
+  uint64_t delta = tick - timer_tick;
+
+  int level;
+  for (level = 0; level < TIMER_LEVELS - 1; level ++)
+    if (delta < (1ULL << LEVEL_SHIFT (level + 1)))
+      break;
+
+  if (delta >= (1ULL << LEVEL_SHIFT (TIMER_LEVELS)))
+    /* Beyond the wheel's range.  Park it in the furthest slot.  */
+    tick = timer_tick + (1ULL << LEVEL_SHIFT (TIMER_LEVELS)) - 1;
+
+  int i = (tick >> LEVEL_SHIFT (level)) & (TIMER_SLOTS - 1);
+  timer->slot = &timer_wheel[level][i];
+  timer_list_enqueue (timer->slot, timer);
+  timer_occupied[level] |= 1ULL << i;
+}
+
+/* Return the first tick at or after TIMER_TICK at which there is
+   something to do: either a timer on level 0 expires or a slot on a
+   higher level is moved down.  A level's slots cover the TIMER_SLOTS
+   blocks starting with the first block that has not yet been moved
+   down.  There must be a pending timer.  */
+static uint64_t
+timer_next_tick (void)
+{
+  assert (timer_count > 0);
+
+  uint64_t next = -1ULL;
+  int level;
+  for (level = 0; level < TIMER_LEVELS; level ++)
+    {
+      int shift = LEVEL_SHIFT (level);
+      uint64_t first = (timer_tick + (1ULL << shift) - 1) >> shift;
+      if ((first << shift) >= next)
+	/* Neither this level nor any higher level can do better.  */
+	break;
+
+      uint64_t bits = timer_occupied[level];
+      if (! bits)
+	continue;
+
+      /* Rotate the bitmap so that bit 0 corresponds to block
+	 FIRST.  */
+      int start = first & (TIMER_SLOTS - 1);
+      if (start)
+	bits = (bits >> start) | (bits << (TIMER_SLOTS - start));
+#if TIMER_SLOTS < 64
+      bits &= (1ULL << TIMER_SLOTS) - 1;
+#endif
+
+      uint64_t b = first + vg_lsb64 (bits) - 1;
+      if ((b << shift) < next)
+	next = b << shift;
+    }
+  assert (next != -1ULL);
+
+  return next;
+}
+
+void
+timer_add (struct timer *timer, uint64_t deadline,
+	   timer_callback_t callback)
+{
+  assert (! timer_pending (timer));
+
+  if (timer_count ++ == 0)
+    /* The wheel is empty.  Start at the current tick.  */
+    timer_tick = timer_clock () >> TIMER_TICK_LOG2;
+
+  timer->deadline = deadline;
+  timer->callback = callback;
+  timer_insert (timer);
+}
+
+void
+timer_cancel (struct timer *timer)
+{
+  if (! timer_pending (timer))
+    return;
+
+  timer_list_unlink (timer->slot, timer);
+  timer_slot_update (timer->slot);
+  timer->slot = NULL;
+
+  assert (timer_count > 0);
+  timer_count --;
+}
+
+int
+timers_run (void)
+{
+  if (timer_count == 0)
+    return 0;
+
+  /* A tick is processed once it is complete.  */
+  uint64_t now_tick = timer_clock () >> TIMER_TICK_LOG2;
+
+  int ran = 0;
+  while (timer_count > 0 && timer_tick < now_tick)
+    {
+      /* Skip the ticks at which there is nothing to do.  */
+      uint64_t t = timer_next_tick ();
+      if (t >= now_tick)
+	{
+	  timer_tick = now_tick;
+	  break;
+	}
+      timer_tick = t;
+
+      /* If T starts a slot on a higher level, move that slot's timers
+	 down.  They all expire at or after T.  */
+      int level;
+      for (level = 1; level < TIMER_LEVELS; level ++)
+	{
+	  if ((t & ((1ULL << LEVEL_SHIFT (level)) - 1)) != 0)
+	    break;
+
+	  struct timer_list *slot
+	    = &timer_wheel[level][(t >> LEVEL_SHIFT (level))
+				  & (TIMER_SLOTS - 1)];
+	  struct timer *timer;
+	  while ((timer = timer_list_dequeue (slot)))
+	    timer_insert (timer);
+	  timer_slot_update (slot);
+	}
+
+      /* Detach the expired timers before running any callbacks: a
+	 callback may add a timer, which must not end up in the slot
+	 being processed.  */
+      struct timer_list *slot = &timer_wheel[0][t & (TIMER_SLOTS - 1)];
+      struct timer_list expired;
+      timer_list_init (&expired, "expired timers");
+      timer_list_move (&expired, slot);
+      timer_slot_update (slot);
+
+      struct timer *timer;
+      for (timer = timer_list_head (&expired); timer;
+	   timer = timer_list_next (timer))
+	timer->slot = &expired;
+
+      timer_tick = t + 1;
+
+      while ((timer = timer_list_dequeue (&expired)))
+	{
+	  timer->slot = NULL;
+	  timer_count --;
+	  ran ++;
+
+	  timer->callback (timer);
+	}
+    }
+
+  return ran;
+}
+
+uint64_t
+timers_next (void)
+{
+  if (timer_count == 0)
+    return 0;
+
+  /* Tick NEXT is processed once it is complete.  */
+  return (timer_next_tick () + 1) << TIMER_TICK_LOG2;
+}
@@ -0,0 +1,95 @@
+/* timer.h - Kernel timer interface.
+   Copyright (C) 2009 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 3 of the
+   License, or (at your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef VIENGOOS_TIMER_H
+#define VIENGOOS_TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "list.h"
+
+/* Timers are kept on a hierarchical timing wheel.  The wheel has
+   TIMER_LEVELS levels of TIMER_SLOTS slots each.  A slot on level 0
+   covers a single tick of 2^TIMER_TICK_LOG2 microseconds, a slot on
+   level L covers TIMER_SLOTS^L ticks.  A timer is placed on the
+   lowest level whose range includes its deadline.  When the wheel
+   reaches a slot on a higher level, the slot's timers are moved to
+   the lower levels.  Adding and cancelling a timer are thus O(1).
+   Timers whose deadline lies beyond the range of the top level are
+   placed in the top level's last slot and moved when it is reached.
+   A bitmap per level records which slots hold timers, so that ticks
+   at which there is nothing to do are skipped.
+
+   Timers are run by the server thread with KERNEL_LOCK held (see
+   timers_run).  A timer never runs before its deadline but may run
+   up to two ticks after it.  All functions must be called with
+   KERNEL_LOCK held.  */
+#define TIMER_TICK_LOG2 10
+#define TIMER_SLOTS_LOG2 6
+#define TIMER_SLOTS (1 << TIMER_SLOTS_LOG2)
+#define TIMER_LEVELS 4
+
+struct timer;
+
+/* A timer's callback.  Called with the timer removed from the
+   wheel.  The callback may add the timer again.  */
+typedef void (*timer_callback_t) (struct timer *timer);
+
+LIST_CLASS_TYPE(timer)
+
+struct timer
+{
+  /* When the timer expires (in the units of l4_system_clock).  */
+  uint64_t deadline;
+  timer_callback_t callback;
+
+  /* The slot the timer is on, or NULL if it is not pending.  */
+  struct timer_list *slot;
+  struct list_node node;
+};
+
+LIST_CLASS(timer, struct timer, node, false)
+
+/* Return whether TIMER is pending.  */
+static inline bool
+timer_pending (struct timer *timer)
+{
+  return timer->slot;
+}
+
+/* Arrange for CALLBACK to be called with TIMER at DEADLINE (in the
+   units of l4_system_clock).  If DEADLINE has passed, CALLBACK is
+   called the next time timers_run is called after the current tick.
+   TIMER must not be pending.  */
+extern void timer_add (struct timer *timer, uint64_t deadline,
+		       timer_callback_t callback);
+
+/* Cancel TIMER.  If TIMER is not pending, does nothing.  */
+extern void timer_cancel (struct timer *timer);
+
+/* Run the expired timers.  Returns the number of timers run.  */
+extern int timers_run (void);
+
+/* Return the time (as returned by l4_system_clock) at which timers_run
+   should next be called, or 0 if there are no pending timers.  */
+extern uint64_t timers_next (void);
+
+#endif
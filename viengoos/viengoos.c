@@ -57,6 +57,9 @@ int ss_lock_trace_count;
 #include "output.h"
 #include "zalloc.h"
 #include "ager.h"
+#include "laundry.h"
+#include "pager.h"
+#include "backing-store.h"
 
 
 #define BUG_ADDRESS	"<bug-hurd@gnu.org>"
@@ -74,6 +77,8 @@ static struct output_driver output_device;
 
 l4_thread_id_t viengoos_tid;
 l4_thread_id_t ager_tid;
+l4_thread_id_t laundry_tid;
+l4_thread_id_t pager_tid;
 
 static void
 parse_args (int argc, char *argv[])
@@ -105,6 +110,8 @@ parse_args (int argc, char *argv[])
 		  " (disabled)"
 #endif
 		  "\n"
+		  "  -b, --backing-store DRV\n"
+		  "                    page objects to the backing store DRV\n"
 		  "  -h, --halt        halt the system at error (default)\n"
 		  "  -r, --reboot      reboot the system at error\n"
 		  "\n"
@@ -127,6 +134,13 @@ parse_args (int argc, char *argv[])
 		printf (".\n\n");
 	    }
 
+	  printf ("Valid backing store drivers are: ");
+	  struct backing_store_driver **bs;
+	  for (bs = backing_store_drivers; *bs; bs ++)
+	    printf ("%s%s", bs == backing_store_drivers ? "" : ", ",
+		    (*bs)->name);
+	  printf ("%s.\n\n", backing_store_drivers[0] ? "" : "none");
+
 	  printf ("Report bugs to " BUG_ADDRESS ".\n");
 	  shutdown_machine ();	  
 	}
@@ -143,6 +157,17 @@ parse_args (int argc, char *argv[])
 	    panic ("Unknown output driver %s", argv[i]);
 	  i++;
 	}
+      else if (!strcmp (argv[i], "-b")
+	       || !strcmp (argv[i], "--backing-store"))
+	{
+	  i++;
+	  if (! backing_store_drivers[0])
+	    panic ("Can't use backing store %s: this kernel has no backing "
+		   "store drivers", argv[i]);
+	  if (!backing_store_init (argv[i]))
+	    panic ("Unknown or unusable backing store %s", argv[i]);
+	  i++;
+	}
       else if (!strcmp (argv[i], "-h") || !strcmp (argv[i], "--halt"))
 	{
 	  i++;
@@ -231,8 +256,10 @@ system_task_load (void)
   return thread;
 }
 
-void
-ager_start (void)
+/* Create a kernel thread whose thread number is NR more than ours
+   and which runs LOOP.  NAME is used for diagnostics.  */
+static l4_thread_id_t
+helper_start (const char *name, int nr, void (*loop) (void))
 {
   const int stack_size = PAGESIZE * 32;
   void *stack = (void *) zalloc (stack_size);
@@ -245,35 +272,54 @@ ager_start (void)
   sp -= sizeof (l4_word_t);
   * (l4_word_t *) sp = 0;
 
-  l4_thread_id_t tid = l4_global_id (l4_thread_no (l4_myself ()) + 1,
+  l4_thread_id_t tid = l4_global_id (l4_thread_no (l4_myself ()) + nr,
 				     l4_version (l4_myself ()));
 
   int ret = l4_thread_control (tid, l4_myself (),
 			       l4_myself (),
 			       l4_myself (),
-			       (void *) _L4_utcb_base () + l4_utcb_size ());
+			       (void *) _L4_utcb_base ()
+			       + nr * l4_utcb_size ());
   if (! ret)
-    panic ("Could not create ager thread (id=%x.%x): %s",
-	   l4_thread_no (tid), l4_version (tid),
+    panic ("Could not create %s thread (id=%x.%x): %s",
+	   name, l4_thread_no (tid), l4_version (tid),
 	   l4_strerror (l4_error_code ()));
 
   
-  debug (1, "Created ager: %x", tid);
-
-  ager_tid = tid;
+  debug (1, "Created %s: %x", name, tid);
 
   l4_thread_id_t targ = tid;
   l4_word_t control = _L4_XCHG_REGS_CANCEL_IPC
     | _L4_XCHG_REGS_SET_SP | _L4_XCHG_REGS_SET_IP;
   l4_word_t dummy = 0;
   l4_word_t sp_arg = (l4_word_t) sp;
-  l4_word_t ip = (l4_word_t) ager_loop;
+  l4_word_t ip = (l4_word_t) loop;
   _L4_exchange_registers (&targ, &control, &sp_arg, &ip,
 			  &dummy, &dummy, &dummy);
   if (targ == l4_nilthread)
-    panic ("Failed to start ager thread (id=%x.%x): %s",
-	   l4_thread_no (tid), l4_version (tid),
+    panic ("Failed to start %s thread (id=%x.%x): %s",
+	   name, l4_thread_no (tid), l4_version (tid),
 	   l4_strerror (l4_error_code ()));
+
+  return tid;
+}
+
+void
+ager_start (void)
+{
+  ager_tid = helper_start ("ager", 1, ager_loop);
+}
+
+void
+laundry_start (void)
+{
+  laundry_tid = helper_start ("laundry", 2, laundry_loop);
+}
+
+void
+pager_start (void)
+{
+  pager_tid = helper_start ("pager", 3, pager_loop);
 }
 
 static void bootstrap (void) __attribute__ ((noinline));
@@ -296,6 +342,9 @@ bootstrap (void)
   object_init ();
 
   ager_start ();
+  if (backing_store)
+    laundry_start ();
+  pager_start ();
 
   /* Load the system task.  */
   struct thread *thread = system_task_load ();
@@ -41,5 +41,10 @@ extern void find_components (void);
 l4_thread_id_t viengoos_tid;
 /* Ager's tid.  */
 l4_thread_id_t ager_tid;
+/* The laundry thread's tid.  Only valid if there is a backing
+   store.  */
+l4_thread_id_t laundry_tid;
+/* The pager thread's tid.  */
+l4_thread_id_t pager_tid;
 
 #endif
@@ -24,10 +24,12 @@
 #endif
 
 #include <assert.h>
+#include <stdbool.h>
 #include <string.h>
 #include <stdint.h>
 #include <hurd/stddef.h>
 #include <viengoos/math.h>
+#include <bit-array.h>
 
 #include "zalloc.h"
 
@@ -81,7 +83,7 @@ uintptr_t zalloc_memory;
    12k.  */
 
 
-/* A free block list ordered by address.  Blocks are of size 2 ** N
+/* A free block list.  Blocks are of size 2 ** N
    and aligned on a similar boundary.  Since the contents of a block
    does not matter (it is free), the block itself contains this
    structure at its start address.  */
@@ -102,6 +104,15 @@ struct block
 static struct block *zone[ZONES];
 
 
+#if ZALLOC_ENGINE == ZALLOC_LIST
+
+/* Each zone's free list is ordered by address.  Finding a block's
+   buddy, and the place to insert it, is linear in the length of the
+   list.  */
+
+/* The largest zone a block may be promoted to plus one.  */
+#define ZONE_LIMIT ZONES
+
 /* Add the block BLOCK to the zone ZONE_NR.  The block has the
    right size and alignment.  Buddy up if possible.  */
 static inline void
@@ -170,6 +181,278 @@ add_block (struct block *block, unsigned int zone_nr)
     }
 }
 
+/* Remove the first block from the non-empty zone ZONE_NR and return
+   it.  */
+static inline struct block *
+remove_first_block (unsigned int zone_nr)
+{
+  struct block *block = zone[zone_nr];
+
+  zone[zone_nr] = block->next;
+  if (zone[zone_nr])
+    zone[zone_nr]->prev = 0;
+
+  return block;
+}
+
+#elif ZALLOC_ENGINE == ZALLOC_BITMAP
+
+/* Each zone's free list is unordered.  Whether a block is free is
+   recorded in a per-zone bitmap so that finding a block's buddy,
+   inserting a block and removing a block are all O(1).
+
+   The bitmaps cover a MAP_PAGES page window starting at MAP_BASE.
+   On ia32, this is the whole address space.  The bitmap for zone Z
+   has MAP_PAGES >> Z bits; they are stored back to back in
+   FREE_MAP.  */
+#define MAP_PAGES ((uintptr_t) 1 << (32 - PAGESIZE_LOG2))
+
+/* The largest zone a block may be promoted to plus one.  A block in
+   the top zone covers half the window.  */
+#define ZONE_LIMIT (ZONES < 32 - PAGESIZE_LOG2 ? ZONES : 32 - PAGESIZE_LOG2)
+
+static unsigned char free_map[2 * MAP_PAGES / 8];
+static uintptr_t map_base;
+static bool map_base_valid;
+
+/* Return the bit in FREE_MAP that says whether the block BLOCK in
+   zone ZONE_NR is free.  */
+static inline int
+map_bit (struct block *block, unsigned int zone_nr)
+{
+  uintptr_t page = ((uintptr_t) block - map_base) >> PAGESIZE_LOG2;
+  assertx (page < MAP_PAGES, "%p outside of window at %p",
+	   block, (void *) map_base);
+
+  return 2 * MAP_PAGES - ((2 * MAP_PAGES) >> zone_nr) + (page >> zone_nr);
+}
+
+/* Remove the free block BLOCK from the zone ZONE_NR.  */
+static inline void
+unlink_block (struct block *block, unsigned int zone_nr)
+{
+  if (block->prev)
+    block->prev->next = block->next;
+  else
+    zone[zone_nr] = block->next;
+  if (block->next)
+    block->next->prev = block->prev;
+
+  bit_set_to (free_map, sizeof (free_map), map_bit (block, zone_nr), 0);
+}
+
+/* Add the block BLOCK to the zone ZONE_NR.  The block has the
+   right size and alignment.  Buddy up if possible.  */
+static inline void
+add_block (struct block *block, unsigned int zone_nr)
+{
+  if (! map_base_valid)
+    /* Center the window on the first block we see.  (The mask is
+       zero if uintptr_t has 32 bits.)  */
+    {
+      map_base = (uintptr_t) block
+	& ~(uintptr_t) ((uint64_t) MAP_PAGES * PAGESIZE - 1);
+      map_base_valid = true;
+    }
+
+  while (zone_nr + 1 < ZONE_LIMIT)
+    {
+      struct block *buddy
+	= (struct block *) ((uintptr_t) block ^ ZONE_SIZE (zone_nr));
+      if (! bit_test (free_map, map_bit (buddy, zone_nr)))
+	break;
+
+      unlink_block (buddy, zone_nr);
+
+      if (buddy < block)
+	block = buddy;
+      zone_nr ++;
+    }
+
+  block->prev = 0;
+  block->next = zone[zone_nr];
+  if (block->next)
+    block->next->prev = block;
+  zone[zone_nr] = block;
+
+  bit_set_to (free_map, sizeof (free_map), map_bit (block, zone_nr), 1);
+}
+
+/* Remove the first block from the non-empty zone ZONE_NR and return
+   it.  */
+static inline struct block *
+remove_first_block (unsigned int zone_nr)
+{
+  struct block *block = zone[zone_nr];
+  unlink_block (block, zone_nr);
+  return block;
+}
+
+#else
+# error Unknown zalloc engine.
+#endif
+
+
+static void zone_free (uintptr_t block, uintptr_t size);
+
+/* Remove a block of size SIZE from the zones and return it.  SIZE
+   must be a multiple of the system's minimum page size.  The memory
+   is not cleared.  Returns 0 if there is no block large enough.  */
+static struct block *
+zone_take (uintptr_t size)
+{
+  unsigned int zone_nr;
+  struct block *block;
+
+  /* Calculate the logarithm to base two of SIZE rounded up to the
+     nearest power of two (actually, the MSB function returns one more
+     than the logarithm to base two of its argument, rounded down to
+     the nearest power of two - this is the same except for the border
+     case where only one bit is set.  To adjust for this border case,
+     we subtract one from the argument to the MSB function).  Calculate
+     the zone number by subtracting page shift.  */
+  zone_nr = vg_msb (size - 1) - PAGESIZE_LOG2;
+
+  /* Find the smallest zone which fits the request and has memory
+     available.  */
+  while (zone_nr < ZONES && !zone[zone_nr])
+    zone_nr++;
+
+  if (zone_nr == ZONES)
+    return 0;
+
+  /* Found a zone.  Now bite off the beginning of the first block in
+     this zone.  */
+  block = remove_first_block (zone_nr);
+
+  /* We may not actually allocate the entire zone, however, the call
+     to zfree will mark the rest as released.  */
+  zalloc_memory -= ZONE_SIZE (zone_nr) / PAGESIZE;
+
+  /* And donate back the remainder of this block, if any.  */
+  if (ZONE_SIZE (zone_nr) > size)
+    zone_free (((uintptr_t) block) + size, ZONE_SIZE (zone_nr) - size);
+
+  return block;
+}
+
+
+/* Single pages are by far the most common allocation.  Rather than
+   split and coalesce buddies each time one is allocated or freed,
+   free single pages are kept on a magazine, a stack of at most
+   ZALLOC_MAGAZINE_SIZE pages linked through their first word.  When
+   the magazine is empty, up to ZALLOC_MAGAZINE_BATCH pages are taken
+   from the zones at once: free single pages first, which cannot be
+   used for anything larger, and only if there are none, a larger
+   block, preferably of ZALLOC_MAGAZINE_BATCH pages.  When the
+   magazine overflows, ZALLOC_MAGAZINE_BATCH pages are returned to the
+   zones.
+
+   Viengoos runs on a single processor and all allocations are made
+   with the kernel lock held, so there is a single magazine.  Pages on
+   the magazine are free and are included in ZALLOC_MEMORY.  */
+#define ZALLOC_MAGAZINE_SIZE 64
+/* Must be a power of two.  */
+#define ZALLOC_MAGAZINE_BATCH 16
+
+static struct block *magazine;
+static int magazine_count;
+
+struct zalloc_magazine_stats zalloc_magazine_stats;
+
+/* Move up to ZALLOC_MAGAZINE_BATCH pages from the zones to the
+   magazine.  Returns the number of pages moved.  */
+static int
+magazine_refill (void)
+{
+  int count = 0;
+
+  void push (uintptr_t page)
+  {
+    struct block *b = (struct block *) page;
+    b->next = magazine;
+    magazine = b;
+    count ++;
+  }
+
+  struct block *block;
+
+  /* Free single pages can't be used for anything larger.  Splitting
+     a larger block while any are left would needlessly fragment
+     memory.  */
+  while (count < ZALLOC_MAGAZINE_BATCH && zone[0]
+	 && (block = zone_take (PAGESIZE)))
+    push ((uintptr_t) block);
+
+  if (count == 0)
+    {
+      block = zone_take (ZALLOC_MAGAZINE_BATCH * PAGESIZE);
+      if (block)
+	{
+	  /* Push the pages in reverse order so that they are handed
+	     out in address order.  */
+	  int i;
+	  for (i = ZALLOC_MAGAZINE_BATCH - 1; i >= 0; i --)
+	    push ((uintptr_t) block + i * PAGESIZE);
+	}
+      else
+	/* Memory is fragmented.  Take what single pages we can get
+	   from the smaller blocks.  */
+	while (count < ZALLOC_MAGAZINE_BATCH
+	       && (block = zone_take (PAGESIZE)))
+	  push ((uintptr_t) block);
+    }
+
+  magazine_count += count;
+  zalloc_memory += count;
+
+  zalloc_magazine_stats.refills ++;
+
+  return count;
+}
+
+/* Return up to COUNT pages from the magazine to the zones.  */
+static void
+magazine_drain (int count)
+{
+  zalloc_magazine_stats.drains ++;
+
+  while (count -- > 0 && magazine)
+    {
+      struct block *b = magazine;
+      magazine = b->next;
+      magazine_count --;
+
+      /* The page remains free: ZALLOC_MEMORY does not change.  */
+      add_block (b, 0);
+    }
+}
+
+
+/* Add the block BLOCK of size SIZE to the zones.  */
+static void
+zone_free (uintptr_t block, uintptr_t size)
+{
+  zalloc_memory += size / PAGESIZE;
+
+  do
+    {
+      /* All blocks must be stored aligned to their size.  */
+      unsigned int block_align = vg_lsb (block) - 1;
+      unsigned int size_align = vg_msb (size) - 1;
+      unsigned int zone_nr = (block_align < size_align
+			      ? block_align : size_align) - PAGESIZE_LOG2;
+      if (zone_nr >= ZONE_LIMIT)
+	zone_nr = ZONE_LIMIT - 1;
+
+      add_block ((struct block *) block, zone_nr);
+
+      block += ZONE_SIZE (zone_nr);
+      size -= ZONE_SIZE (zone_nr);
+    }
+  while (size > 0);
+}
+
 
 /* Add the block BLOCK of size SIZE to the pool.  BLOCK must be
    aligned to the system's minimum page size.  SIZE must be a multiple
@@ -190,22 +473,21 @@ zfree (uintptr_t block, uintptr_t size)
     panic ("%s: freed block 0x%x of size 0x%x is not aligned to "
 	   "minimum page size", __func__, block, size);
 
-  zalloc_memory += size / PAGESIZE;
-
-  do
+  if (size == PAGESIZE)
     {
-      /* All blocks must be stored aligned to their size.  */
-      unsigned int block_align = vg_lsb (block) - 1;
-      unsigned int size_align = vg_msb (size) - 1;
-      unsigned int zone_nr = (block_align < size_align
-			      ? block_align : size_align) - PAGESIZE_LOG2;
+      struct block *b = (struct block *) block;
+      b->next = magazine;
+      magazine = b;
+      magazine_count ++;
+      zalloc_memory ++;
 
-      add_block ((struct block *) block, zone_nr);
+      if (magazine_count > ZALLOC_MAGAZINE_SIZE)
+	magazine_drain (ZALLOC_MAGAZINE_BATCH);
 
-      block += ZONE_SIZE (zone_nr);
-      size -= ZONE_SIZE (zone_nr);
+      return;
     }
-  while (size > 0);
+
+  zone_free (block, size);
 }
 
 
@@ -215,7 +497,6 @@ zfree (uintptr_t block, uintptr_t size)
 uintptr_t
 zalloc_internal (uintptr_t size)
 {
-  unsigned int zone_nr;
   struct block *block;
 
   debug (5, "request for 0x%x pages (%d pages available)",
@@ -225,48 +506,67 @@ zalloc_internal (uintptr_t size)
     panic ("%s: requested size 0x%x is not a multiple of "
 	   "minimum page size", __func__, size);
 
-  /* Calculate the logarithm to base two of SIZE rounded up to the
-     nearest power of two (actually, the MSB function returns one more
-     than the logarithm to base two of its argument, rounded down to
-     the nearest power of two - this is the same except for the border
-     case where only one bit is set.  To adjust for this border case,
-     we subtract one from the argument to the MSB function).  Calculate
-     the zone number by subtracting page shift.  */
-  zone_nr = vg_msb (size - 1) - PAGESIZE_LOG2;
-
-  /* Find the smallest zone which fits the request and has memory
-     available.  */
-  while (!zone[zone_nr] && zone_nr < ZONES)
-    zone_nr++;
+  if (size == PAGESIZE)
+    {
+      if (magazine)
+	zalloc_magazine_stats.hits ++;
+      else
+	{
+	  zalloc_magazine_stats.misses ++;
+	  if (! magazine_refill ())
+	    {
+	      debug (4, "Cannot allocate a block of %d bytes!", size);
+	      assert (zalloc_memory == 0);
+	      return 0;
+	    }
+	}
 
-  if (zone_nr == ZONES)
+      block = magazine;
+      magazine = block->next;
+      magazine_count --;
+      zalloc_memory --;
+    }
+  else
     {
-      debug (4, "Cannot allocate a block of %d bytes!", size);
-      if (size == PAGESIZE)
-	assert (zalloc_memory == 0);
-      return 0;
+      block = zone_take (size);
+      if (! block && magazine)
+	/* The pages on the magazine might be buddies of blocks in the
+	   zones.  Return them and try again.  */
+	{
+	  magazine_drain (magazine_count);
+	  block = zone_take (size);
+	}
+
+      if (! block)
+	{
+	  debug (4, "Cannot allocate a block of %d bytes!", size);
+	  return 0;
+	}
     }
 
-  /* Found a zone.  Now bite off the beginning of the first block in
-     this zone.  */
-  block = zone[zone_nr];
+  /* Zero out the newly allocated block.  */
+  memset (block, 0, size);
 
-  zone[zone_nr] = block->next;
-  if (zone[zone_nr])
-    zone[zone_nr]->prev = 0;
+  return (uintptr_t) block;
+}
 
-  /* We may not actually allocate the entire zone, however, the call
-     to zfree will mark the rest as released.  */
-  zalloc_memory -= ZONE_SIZE (zone_nr) / PAGESIZE;
 
-  /* And donate back the remainder of this block, if any.  */
-  if (ZONE_SIZE (zone_nr) > size)
-    zfree (((uintptr_t) block) + size, ZONE_SIZE (zone_nr) - size);
+int
+zalloc_fragmentation (void)
+{
+  if (zalloc_memory == 0)
+    return 0;
 
-  /* Zero out the newly allocated block.  */
-  memset (block, 0, size);
+  int i;
+  for (i = ZONES - 1; i >= 0; i --)
+    if (zone[i])
+      break;
 
-  return (uintptr_t) block;
+  uintptr_t largest = i >= 0 ? ZONE_SIZE (i) / PAGESIZE : 0;
+  if (magazine && largest == 0)
+    largest = 1;
+
+  return 100 - (100 * largest) / zalloc_memory;
 }
 
 
@@ -297,12 +597,22 @@ zalloc_dump_zones (const char *prefix)
 	printf ("} = %d pages\n", count * ZONE_SIZE (i) / PAGESIZE);
       }
 
+  printf ("%s%smagazine: %d pages; %d hits, %d misses, "
+	  "%d refills, %d drains\n",
+	  prefix ?: "", prefix ? ": " : "", magazine_count,
+	  zalloc_magazine_stats.hits, zalloc_magazine_stats.misses,
+	  zalloc_magazine_stats.refills, zalloc_magazine_stats.drains);
+  available += magazine_count;
+
   printf ("%s%s%llu (0x%llx) kbytes (%d pages) available\n",
 	  prefix ?: "", prefix ? ": " : "",
 	  (unsigned long long) 4 * available,
 	  (unsigned long long) 4 * available,
 	  available);
 
+  printf ("%s%s%d%% fragmented\n",
+	  prefix ?: "", prefix ? ": " : "", zalloc_fragmentation ());
+
   assertx (available == zalloc_memory, "%d != %d", available, zalloc_memory);
 }
 #endif
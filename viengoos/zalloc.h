@@ -24,6 +24,23 @@
 #include <stdint.h>
 #include <hurd/stddef.h>
 
+/* The zone engines.  ZALLOC_LIST keeps each zone's free blocks on a
+   list ordered by address; coalescing a block is linear in the length
+   of the list.  ZALLOC_BITMAP additionally records which blocks are
+   free in a per-zone bitmap, which makes coalescing O(1) at the cost
+   of 256 kb of bitmaps.  The engine is selected at build time (see
+   --with-zalloc-engine).  */
+#define ZALLOC_LIST 1
+#define ZALLOC_BITMAP 2
+
+#ifndef ZALLOC_ENGINE
+# ifdef ZALLOC_DEFAULT_ENGINE
+#  define ZALLOC_ENGINE ZALLOC_DEFAULT_ENGINE
+# else
+#  define ZALLOC_ENGINE ZALLOC_LIST
+# endif
+#endif
+
 /* The amount of memory available (in PAGESIZE units).  */
 extern uintptr_t zalloc_memory;
 
@@ -45,6 +62,24 @@ zalloc (uintptr_t size)
   return zalloc_internal (size);
 }
 
+/* Statistics about the single page magazine.  An allocation is a
+   hit if the magazine was not empty.  */
+struct zalloc_magazine_stats
+{
+  int hits;
+  int misses;
+  /* The number of times pages were moved from the zones to the
+     magazine and back.  */
+  int refills;
+  int drains;
+};
+
+extern struct zalloc_magazine_stats zalloc_magazine_stats;
+
+/* Return the percentage of the available memory that is not part of
+   the largest free block.  */
+int zalloc_fragmentation (void);
+
 /* Dump some internal data structures.  Only defined if zalloc was
    compiled without NDEBUG defined.  */
 void zalloc_dump_zones (const char *prefix);